@@ -0,0 +1,303 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dispatch.h"
+
+/* Difference distribution (DDT) and linear approximation (LAT) tables of
+S-boxes and small round functions, given as a lookup table f: n bits -> m bits
+(n, m <= 16).
+  DDT[a][b] = #{x : f(x) ^ f(x ^ a) = b}
+  LAT[a][b] = #{x : a.x = b.f(x)} - 2^(n-1)
+The LAT is computed one output mask b at a time with a Walsh-Hadamard transform
+of (-1)^(b.f(x)), i.e. n * 2^n operations per column instead of 2^(2n).
+Rows/columns are spread over threads and can be streamed to a binary file, so a
+16-bit function (2^32 entries per table) never has to fit in memory */
+
+#define ANALYSIS_MAX_BITS 16
+
+typedef struct {
+    const char *name;
+    uint32_t inbits;
+    uint32_t outbits;
+    const uint16_t *table; // 2^inbits entries
+} analysis_func_t;
+
+typedef struct {
+    uint32_t max_ddt;   // largest DDT entry with a != 0
+    uint32_t max_ddt_a;
+    uint32_t max_ddt_b;
+    double max_dp;      // max_ddt / 2^n, best differential probability
+    uint32_t max_lat;   // largest |LAT| entry with b != 0
+    uint32_t max_lat_a;
+    uint32_t max_lat_b;
+    double max_bias;    // max_lat / 2^n, best linear bias
+} analysis_summary_t;
+
+/* Binary table files: a header followed by the table.
+  DDT file: rows a = 0 .. 2^n-1, each 2^m uint16 entries holding DDT[a][b] / 2 (DDT entries are even)
+  LAT file: rows b = 0 .. 2^m-1 (output mask major), each 2^n entries LAT[a][b],
+            int16 when n < 16, int32 when n = 16 (|LAT| can reach 2^15)
+All values in host byte order */
+typedef struct {
+    char magic[4];      // "DDT1" or "LAT1"
+    uint32_t inbits;
+    uint32_t outbits;
+    uint32_t entrysize; // bytes per entry
+} analysis_file_header_t;
+
+// ddt may be NULL (2^(n+m) entries, row a major), out may be NULL
+void analysis_ddt(const analysis_func_t *f, uint32_t *ddt, FILE *out, analysis_summary_t *summary, uint32_t threadscount);
+// lat may be NULL (2^(n+m) entries, row b major), out may be NULL
+void analysis_lat(const analysis_func_t *f, int32_t *lat, FILE *out, analysis_summary_t *summary, uint32_t threadscount);
+
+#ifdef ANALYSIS_IMPL
+
+// the transform kernel is picked by cpu level
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef DISPATCH_IMPL
+#define DISPATCH_IMPL
+#endif
+#include "dispatch.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// rows computed per thread before the window is merged and written
+#define ANALYSIS_ROWS_PER_THREAD 16
+
+typedef struct {
+    const analysis_func_t *f;
+    int lat;
+    uint32_t first;   // first row of the window
+    uint32_t rows;    // rows in the window
+    uint32_t thread;
+    uint32_t threadscount;
+    int32_t *window;  // rows * rowsize entries
+    uint32_t best;    // max entry of this thread (excluding the trivial row)
+    uint32_t best_row;
+    uint32_t best_col;
+} analysis_job_t;
+
+static void analysis_ddt_row(const analysis_func_t *f, uint32_t a, int32_t *row) {
+    uint32_t size = 1u << f->inbits;
+    memset(row, 0, sizeof(int32_t) << f->outbits);
+    if (a == 0) {
+        row[0] = size;
+        return;
+    }
+    // x and x ^ a give the same output difference, so only count x < x ^ a
+    uint32_t high = 1u << (31 - __builtin_clz(a));
+    for (uint32_t x = 0; x < size; ++x) {
+        if (x & high) continue;
+        row[f->table[x] ^ f->table[x ^ a]] += 2;
+    }
+}
+
+typedef void (*analysis_wht_kernel_t)(int32_t *v, uint32_t size);
+
+// in-place walsh-hadamard transform, size a power of two
+static void analysis_wht_scalar(int32_t *v, uint32_t size) {
+    for (uint32_t h = 1; h < size; h <<= 1) {
+        for (uint32_t i = 0; i < size; i += 2 * h) {
+            for (uint32_t j = i; j < i + h; ++j) {
+                int32_t u = v[j];
+                int32_t w = v[j + h];
+                v[j]      = u + w;
+                v[j + h]  = u - w;
+            }
+        }
+    }
+}
+
+#if DISPATCH_X86
+
+#include <immintrin.h>
+
+/* stages h = 1, 2, 4 stay inside one 8-lane register (partner lane via shuffle,
+lower lane keeps the sum, upper lane takes partner - self), the rest are
+butterflies between whole registers */
+DISPATCH_TARGET("avx2")
+static void analysis_wht_avx2(int32_t *v, uint32_t size) {
+    if (size < 8) {
+        analysis_wht_scalar(v, size);
+        return;
+    }
+    for (uint32_t i = 0; i < size; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+        __m256i y = _mm256_shuffle_epi32(x, 0xB1);
+        x         = _mm256_blend_epi32(_mm256_add_epi32(x, y), _mm256_sub_epi32(y, x), 0xAA);
+        y         = _mm256_shuffle_epi32(x, 0x4E);
+        x         = _mm256_blend_epi32(_mm256_add_epi32(x, y), _mm256_sub_epi32(y, x), 0xCC);
+        y         = _mm256_permute2x128_si256(x, x, 0x01);
+        x         = _mm256_blend_epi32(_mm256_add_epi32(x, y), _mm256_sub_epi32(y, x), 0xF0);
+        _mm256_storeu_si256((__m256i *)(v + i), x);
+    }
+    for (uint32_t h = 8; h < size; h <<= 1) {
+        for (uint32_t i = 0; i < size; i += 2 * h) {
+            for (uint32_t j = i; j < i + h; j += 8) {
+                __m256i u = _mm256_loadu_si256((const __m256i *)(v + j));
+                __m256i w = _mm256_loadu_si256((const __m256i *)(v + j + h));
+                _mm256_storeu_si256((__m256i *)(v + j), _mm256_add_epi32(u, w));
+                _mm256_storeu_si256((__m256i *)(v + j + h), _mm256_sub_epi32(u, w));
+            }
+        }
+    }
+}
+
+#endif
+
+static analysis_wht_kernel_t analysis_wht_kernel = NULL;
+
+// picked by the calling thread before any worker starts
+static void analysis_wht_select(void) {
+    if (DISPATCH_LOAD(analysis_wht_kernel)) return;
+    dispatch_level_t chosen      = DISPATCH_SCALAR;
+    analysis_wht_kernel_t kernel = analysis_wht_scalar;
+#if DISPATCH_X86
+    if (dispatch_level() >= DISPATCH_AVX2) { kernel = analysis_wht_avx2; chosen = DISPATCH_AVX2; }
+#endif
+    dispatch_note("analysis wht", chosen);
+    DISPATCH_STORE(analysis_wht_kernel, kernel);
+}
+
+// column b of the LAT: walsh transform of (-1)^(b.f(x)), halved
+static void analysis_lat_row(const analysis_func_t *f, uint32_t b, int32_t *row) {
+    uint32_t size = 1u << f->inbits;
+    for (uint32_t x = 0; x < size; ++x) {
+        row[x] = 1 - 2 * (__builtin_popcount(b & f->table[x]) & 1);
+    }
+    DISPATCH_LOAD(analysis_wht_kernel)(row, size);
+    for (uint32_t a = 0; a < size; ++a) {
+        row[a] /= 2;
+    }
+}
+
+static void *analysis_worker(void *arg) {
+    analysis_job_t *job  = (analysis_job_t *)arg;
+    uint32_t rowsize     = 1u << (job->lat ? job->f->inbits : job->f->outbits);
+    for (uint32_t r = job->thread; r < job->rows; r += job->threadscount) {
+        uint32_t index = job->first + r;
+        int32_t *row   = job->window + (size_t)r * rowsize;
+        if (job->lat) analysis_lat_row(job->f, index, row);
+        else          analysis_ddt_row(job->f, index, row);
+        if (index == 0) continue; // trivial row: a = 0 (DDT) or b = 0 (LAT)
+        for (uint32_t c = 0; c < rowsize; ++c) {
+            uint32_t v = row[c] < 0 ? -row[c] : row[c];
+            if (v > job->best) {
+                job->best     = v;
+                job->best_row = index;
+                job->best_col = c;
+            }
+        }
+    }
+    return NULL;
+}
+
+// packs a window into the file's entry size and writes it with one call
+static void analysis_write(FILE *out, const int32_t *window, size_t count, int lat, uint32_t entrysize, void *buf) {
+    if (entrysize == 4) {
+        fwrite(window, 4, count, out);
+        return;
+    }
+    int16_t *packed = (int16_t *)buf;
+    for (size_t i = 0; i < count; ++i) {
+        packed[i] = (int16_t)(lat ? window[i] : window[i] / 2);
+    }
+    fwrite(packed, 2, count, out);
+}
+
+static void analysis_run(const analysis_func_t *f, int lat, int32_t *full, FILE *out, analysis_summary_t *summary, uint32_t threadscount) {
+    if (f->inbits > ANALYSIS_MAX_BITS || f->outbits > ANALYSIS_MAX_BITS) {
+        fprintf(stderr, "%s: at most %d input/output bits\n", f->name, ANALYSIS_MAX_BITS);
+        exit(1);
+    }
+    if (threadscount == 0) threadscount = 1;
+    if (lat) analysis_wht_select();
+    uint32_t rowscount = 1u << (lat ? f->outbits : f->inbits);
+    uint32_t rowsize   = 1u << (lat ? f->inbits : f->outbits);
+    uint32_t entrysize = lat && f->inbits == 16 ? 4 : 2;
+    if (threadscount > rowscount) threadscount = rowscount;
+
+    if (out) {
+        analysis_file_header_t header = {{'D', 'D', 'T', '1'}, f->inbits, f->outbits, entrysize};
+        if (lat) memcpy(header.magic, "LAT1", 4);
+        fwrite(&header, sizeof(header), 1, out);
+    }
+
+    uint32_t windowrows = threadscount * ANALYSIS_ROWS_PER_THREAD;
+    int32_t *window     = (int32_t *)malloc((size_t)windowrows * rowsize * sizeof(int32_t));
+    pthread_t *threads  = (pthread_t *)malloc(threadscount * sizeof(pthread_t));
+    analysis_job_t *jobs = (analysis_job_t *)calloc(threadscount, sizeof(analysis_job_t));
+    void *packed         = out && entrysize == 2 ? malloc((size_t)windowrows * rowsize * 2) : NULL;
+
+    for (uint32_t first = 0; first < rowscount; first += windowrows) {
+        uint32_t rows = rowscount - first < windowrows ? rowscount - first : windowrows;
+        for (uint32_t t = 0; t < threadscount; ++t) {
+            jobs[t].f            = f;
+            jobs[t].lat          = lat;
+            jobs[t].first        = first;
+            jobs[t].rows         = rows;
+            jobs[t].thread       = t;
+            jobs[t].threadscount = threadscount;
+            jobs[t].window       = window;
+        }
+        // slice 0 runs on the caller, as does any slice whose thread could not be started
+        threads[0] = pthread_self();
+        for (uint32_t t = 1; t < threadscount; ++t) {
+            if (pthread_create(&threads[t], NULL, analysis_worker, &jobs[t])) {
+                analysis_worker(&jobs[t]);
+                threads[t] = pthread_self();
+            }
+        }
+        analysis_worker(&jobs[0]);
+        for (uint32_t t = 1; t < threadscount; ++t) {
+            if (!pthread_equal(threads[t], pthread_self())) pthread_join(threads[t], NULL);
+        }
+
+        if (full) memcpy(full + (size_t)first * rowsize, window, (size_t)rows * rowsize * sizeof(int32_t));
+        if (out)  analysis_write(out, window, (size_t)rows * rowsize, lat, entrysize, packed);
+    }
+
+    uint32_t best = 0, best_row = 0, best_col = 0;
+    for (uint32_t t = 0; t < threadscount; ++t) {
+        // ties go to the lowest row, so the result does not depend on the thread count
+        if (jobs[t].best > best || (jobs[t].best == best && best && jobs[t].best_row < best_row)) {
+            best     = jobs[t].best;
+            best_row = jobs[t].best_row;
+            best_col = jobs[t].best_col;
+        }
+    }
+    if (summary && lat) {
+        summary->max_lat   = best;
+        summary->max_lat_a = best_col;
+        summary->max_lat_b = best_row;
+        summary->max_bias  = (double)best / (1u << f->inbits);
+    } else if (summary) {
+        summary->max_ddt   = best;
+        summary->max_ddt_a = best_row;
+        summary->max_ddt_b = best_col;
+        summary->max_dp    = (double)best / (1u << f->inbits);
+    }
+
+    free(window);
+    free(threads);
+    free(jobs);
+    free(packed);
+}
+
+void analysis_ddt(const analysis_func_t *f, uint32_t *ddt, FILE *out, analysis_summary_t *summary, uint32_t threadscount) {
+    analysis_run(f, 0, (int32_t *)ddt, out, summary, threadscount);
+}
+
+void analysis_lat(const analysis_func_t *f, int32_t *lat, FILE *out, analysis_summary_t *summary, uint32_t threadscount) {
+    analysis_run(f, 1, lat, out, summary, threadscount);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,417 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define DISPATCH_IMPL
+#define CIPHER_IMPL
+#define SPNET_IMPL
+#define FEISTEL_SPNET_IMPL
+#define DES_IMPL
+
+#include "dispatch.h"
+#include "cipher.h"
+#include "ciphers/spnet.h"
+#include "ciphers/feistel_spnet.h"
+#include "ciphers/des.h"
+
+#if DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+/* Avalanche / diffusion analysis.
+For random (plaintext, key) samples every input bit (plaintext bits, or key
+bits with --key) is flipped and the output difference is recorded:
+  avalanche - mean number of output bits flipped per input bit (ideal: half)
+  SAC       - P(output bit j flips | input bit i flipped), ideal 0.5 for every (i, j)
+  BIC       - correlation of output bits j and k flipping together, ideal 0
+Samples go in groups of 64: the 64 differences of one input bit are transposed
+into bit-planes, so every SAC/BIC counter is updated with one popcount
+(dispatched: popcnt, or avx512 vpopcntq for 8 counters at once).
+In key mode the 64 samples of a group share a random key and have their own
+plaintexts, so each of the in + 1 key schedules encrypts 64 blocks in one batch.
+Input bits that never change the output (key bits the schedule drops) are
+listed and left out of the summaries; in key mode the sampling noise is
+estimated from the number of distinct keys.
+
+usage: ./avalanche.out <cipher> [--rounds R] [--samples N] [--threads T] [--key] [--seed S] [--no-bic] [--matrix] */
+
+#define AVALANCHE_GROUP 64
+
+typedef struct {
+    const cipher_desc_t *cipher;
+    uint32_t rounds;
+    int key_mode;
+    int bic;
+    uint32_t inbits;
+    uint32_t outbits;
+} avalanche_cfg_t;
+
+typedef struct {
+    const avalanche_cfg_t *cfg;
+    uint64_t samples;
+    uint64_t seed;
+    uint64_t *flips; // [inbits][outbits]
+    uint64_t *pairs; // [inbits][outbits][outbits], j < k only
+} avalanche_job_t;
+
+static uint64_t avalanche_rand(uint64_t *state) {
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void avalanche_fill(uint64_t *state, uint8_t *buf, uint32_t len) {
+    for (uint32_t i = 0; i < len; i += 8) {
+        uint64_t r = avalanche_rand(state);
+        memcpy(buf + i, &r, len - i < 8 ? len - i : 8);
+    }
+}
+
+static uint64_t avalanche_load(const uint8_t *block, uint32_t bs) {
+    uint64_t v = 0;
+    memcpy(&v, block, bs);
+    return v;
+}
+
+/* SAC/BIC counters of one input bit: flips[j] += popcount(planes[j]) and, if
+pairs is not NULL, pairs[j * out + k] += popcount(planes[j] & planes[k]), k > j */
+typedef void (*avalanche_count_kernel_t)(const uint64_t *planes, uint32_t out, uint64_t *flips, uint64_t *pairs);
+
+static void avalanche_count_scalar(const uint64_t *planes, uint32_t out, uint64_t *flips, uint64_t *pairs) {
+    for (uint32_t j = 0; j < out; ++j) {
+        flips[j] += __builtin_popcountll(planes[j]);
+    }
+    if (!pairs) return;
+    for (uint32_t j = 0; j < out; ++j) {
+        for (uint32_t k = j + 1; k < out; ++k) {
+            pairs[j * out + k] += __builtin_popcountll(planes[j] & planes[k]);
+        }
+    }
+}
+
+#if DISPATCH_X86
+
+// the same loops, the builtin becomes one popcnt instruction instead of a bit-twiddling sequence
+DISPATCH_TARGET("popcnt")
+static void avalanche_count_popcnt(const uint64_t *planes, uint32_t out, uint64_t *flips, uint64_t *pairs) {
+    for (uint32_t j = 0; j < out; ++j) {
+        flips[j] += __builtin_popcountll(planes[j]);
+    }
+    if (!pairs) return;
+    for (uint32_t j = 0; j < out; ++j) {
+        for (uint32_t k = j + 1; k < out; ++k) {
+            pairs[j * out + k] += __builtin_popcountll(planes[j] & planes[k]);
+        }
+    }
+}
+
+// 8 counters per vector, the last vector of a row is masked
+DISPATCH_TARGET("avx512f,avx512vpopcntdq")
+static void avalanche_count_avx512(const uint64_t *planes, uint32_t out, uint64_t *flips, uint64_t *pairs) {
+    for (uint32_t j = 0; j < out; j += 8) {
+        __mmask8 m = out - j < 8 ? (__mmask8)((1u << (out - j)) - 1) : 0xFF;
+        __m512i p  = _mm512_maskz_loadu_epi64(m, planes + j);
+        __m512i f  = _mm512_maskz_loadu_epi64(m, flips + j);
+        _mm512_mask_storeu_epi64(flips + j, m, _mm512_add_epi64(f, _mm512_popcnt_epi64(p)));
+    }
+    if (!pairs) return;
+    for (uint32_t j = 0; j < out; ++j) {
+        __m512i pj    = _mm512_set1_epi64((long long)planes[j]);
+        uint64_t *row = pairs + (size_t)j * out;
+        for (uint32_t k = j + 1; k < out; k += 8) {
+            __mmask8 m = out - k < 8 ? (__mmask8)((1u << (out - k)) - 1) : 0xFF;
+            __m512i pk = _mm512_maskz_loadu_epi64(m, planes + k);
+            __m512i c  = _mm512_maskz_loadu_epi64(m, row + k);
+            _mm512_mask_storeu_epi64(row + k, m, _mm512_add_epi64(c, _mm512_popcnt_epi64(_mm512_and_si512(pj, pk))));
+        }
+    }
+}
+
+#endif
+
+static void avalanche_count_resolve(const uint64_t *planes, uint32_t out, uint64_t *flips, uint64_t *pairs);
+static avalanche_count_kernel_t avalanche_count_kernel = avalanche_count_resolve;
+
+/* first call picks the kernel for this cpu and replaces itself; popcnt and
+vpopcntq are not part of a dispatch level, so they are checked on their own
+on top of the level they come with (sse2 and avx512) */
+static void avalanche_count_resolve(const uint64_t *planes, uint32_t out, uint64_t *flips, uint64_t *pairs) {
+    dispatch_level_t level          = dispatch_level();
+    dispatch_level_t chosen         = DISPATCH_SCALAR;
+    avalanche_count_kernel_t kernel = avalanche_count_scalar;
+#if DISPATCH_X86
+    if (level >= DISPATCH_AVX512 && __builtin_cpu_supports("avx512vpopcntdq")) {
+        kernel = avalanche_count_avx512;
+        chosen = DISPATCH_AVX512;
+    } else if (level >= DISPATCH_SSE2 && __builtin_cpu_supports("popcnt")) {
+        kernel = avalanche_count_popcnt;
+        chosen = DISPATCH_SSE2;
+    }
+#else
+    (void)level;
+#endif
+    dispatch_note("avalanche popcount", chosen);
+    DISPATCH_STORE(avalanche_count_kernel, kernel);
+    kernel(planes, out, flips, pairs);
+}
+
+static void *avalanche_worker(void *arg) {
+    avalanche_job_t *job        = (avalanche_job_t *)arg;
+    const avalanche_cfg_t *cfg  = job->cfg;
+    const cipher_desc_t *cipher = cfg->cipher;
+    uint32_t bs = cipher->blocksize, ks = cipher->keysize;
+    uint32_t in = cfg->inbits, out = cfg->outbits;
+    uint64_t rng = job->seed;
+
+    // diffs[i][s] = output difference of sample s when input bit i is flipped
+    uint64_t *diffs = (uint64_t *)calloc((size_t)in * AVALANCHE_GROUP, sizeof(uint64_t));
+    uint8_t *blocks = (uint8_t *)malloc((size_t)(in + 1) * bs * (cfg->key_mode ? AVALANCHE_GROUP : 1));
+    uint8_t *plain  = (uint8_t *)malloc((size_t)AVALANCHE_GROUP * bs);
+    uint8_t *keys   = (uint8_t *)malloc((size_t)(in + 1) * ks);
+    uint8_t *ctxs   = (uint8_t *)malloc((size_t)(cfg->key_mode ? in + 1 : 1) * cipher->ctxsize);
+
+    for (uint64_t done = 0; done < job->samples; done += AVALANCHE_GROUP) {
+        uint32_t group = job->samples - done < AVALANCHE_GROUP ? (uint32_t)(job->samples - done) : AVALANCHE_GROUP;
+        memset(diffs, 0, (size_t)in * AVALANCHE_GROUP * sizeof(uint64_t));
+
+        if (cfg->key_mode) {
+            // base key + one flipped key per bit, expanded in one batch,
+            // then the group's plaintexts under every key: blocks[key][s]
+            avalanche_fill(&rng, keys, ks);
+            for (uint32_t i = 0; i < in; ++i) {
+                memcpy(keys + (i + 1) * ks, keys, ks);
+                keys[(i + 1) * ks + i / 8] ^= 1 << (i % 8);
+            }
+            cipher_setkey_batch(cipher, ctxs, keys, in + 1, cfg->rounds);
+            avalanche_fill(&rng, plain, group * bs);
+            for (uint32_t i = 0; i <= in; ++i) {
+                cipher_enc_batch(cipher, ctxs + (size_t)i * cipher->ctxsize, blocks + (size_t)i * AVALANCHE_GROUP * bs, plain, group);
+            }
+            for (uint32_t s = 0; s < group; ++s) {
+                uint64_t base = avalanche_load(blocks + s * bs, bs);
+                for (uint32_t i = 0; i < in; ++i) {
+                    diffs[(size_t)i * AVALANCHE_GROUP + s] = base ^ avalanche_load(blocks + ((size_t)(i + 1) * AVALANCHE_GROUP + s) * bs, bs);
+                }
+            }
+        } else {
+            for (uint32_t s = 0; s < group; ++s) {
+                // base block + one flipped block per bit, all in one batch call
+                avalanche_fill(&rng, blocks, bs);
+                avalanche_fill(&rng, keys, ks);
+                cipher->setkey(ctxs, keys, cfg->rounds);
+                for (uint32_t i = 0; i < in; ++i) {
+                    memcpy(blocks + (i + 1) * bs, blocks, bs);
+                    blocks[(i + 1) * bs + i / 8] ^= 1 << (i % 8);
+                }
+                cipher_enc_batch(cipher, ctxs, blocks, blocks, in + 1);
+                uint64_t base = avalanche_load(blocks, bs);
+                for (uint32_t i = 0; i < in; ++i) {
+                    diffs[(size_t)i * AVALANCHE_GROUP + s] = base ^ avalanche_load(blocks + (i + 1) * bs, bs);
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < in; ++i) {
+            uint64_t *planes = diffs + (size_t)i * AVALANCHE_GROUP; // planes[j] bit s = output bit j of sample s
+            cipher_transpose64(planes);
+            uint64_t *flips = job->flips + (size_t)i * out;
+            uint64_t *pairs = cfg->bic ? job->pairs + (size_t)i * out * out : NULL;
+            DISPATCH_LOAD(avalanche_count_kernel)(planes, out, flips, pairs);
+        }
+    }
+
+    free(diffs);
+    free(blocks);
+    free(plain);
+    free(keys);
+    free(ctxs);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    cipher_register(&SP_net32_cipher);
+    cipher_register(&feistel_SP_net32_cipher);
+    cipher_register(&des_cipher);
+
+    if (argc < 2 || !cipher_find(argv[1])) {
+        fprintf(stderr, "usage: %s <cipher> [--rounds R] [--samples N] [--threads T] [--key] [--seed S] [--no-bic] [--matrix]\nciphers:", argv[0]);
+        for (uint32_t i = 0; i < cipher_count(); ++i) fprintf(stderr, " %s", cipher_get(i)->name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    avalanche_cfg_t cfg;
+    cfg.cipher   = cipher_find(argv[1]);
+    cfg.rounds   = cfg.cipher->default_rounds;
+    cfg.key_mode = 0;
+    cfg.bic      = 1;
+    uint64_t samples  = 1 << 16;
+    uint64_t seed     = 0x9E3779B97F4A7C15ULL;
+    long threadscount = sysconf(_SC_NPROCESSORS_ONLN);
+    int matrix        = 0;
+    for (int i = 2; i < argc; ++i) {
+        if      (!strcmp(argv[i], "--rounds")  && i + 1 < argc) cfg.rounds   = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--samples") && i + 1 < argc) samples      = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threadscount = strtol(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--seed")    && i + 1 < argc) seed         = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--key"))    cfg.key_mode = 1;
+        else if (!strcmp(argv[i], "--no-bic")) cfg.bic      = 0;
+        else if (!strcmp(argv[i], "--matrix")) matrix       = 1;
+        else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (cfg.cipher->blocksize > 8) {
+        fprintf(stderr, "%s: only blocks up to 64 bits are supported\n", cfg.cipher->name);
+        return 1;
+    }
+    if (threadscount < 1) threadscount = 1;
+    if (samples == 0) samples = 1;
+    cfg.inbits  = 8 * (cfg.key_mode ? cfg.cipher->keysize : cfg.cipher->blocksize);
+    cfg.outbits = 8 * cfg.cipher->blocksize;
+    uint32_t in = cfg.inbits, out = cfg.outbits;
+
+    // one job per thread with private counters, merged afterwards
+    pthread_t *threads    = (pthread_t *)malloc(threadscount * sizeof(pthread_t));
+    avalanche_job_t *jobs = (avalanche_job_t *)malloc(threadscount * sizeof(avalanche_job_t));
+    for (long t = 0; t < threadscount; ++t) {
+        jobs[t].cfg     = &cfg;
+        jobs[t].samples = samples * (t + 1) / threadscount - samples * t / threadscount;
+        jobs[t].seed    = seed ^ (0xD1B54A32D192ED03ULL * (t + 1));
+        jobs[t].flips   = (uint64_t *)calloc((size_t)in * out, sizeof(uint64_t));
+        jobs[t].pairs   = cfg.bic ? (uint64_t *)calloc((size_t)in * out * out, sizeof(uint64_t)) : NULL;
+    }
+    // resolve the dispatched kernels before the threads start
+    uint8_t block[CIPHER_MAX_BLOCKSIZE] = {0};
+    uint8_t *key = (uint8_t *)calloc(cfg.cipher->keysize, 1);
+    void *ctx    = malloc(cfg.cipher->ctxsize);
+    cfg.cipher->setkey(ctx, key, cfg.rounds);
+    cipher_enc_batch(cfg.cipher, ctx, block, block, 1);
+    uint64_t plane = 0, count = 0;
+    avalanche_count_resolve(&plane, 1, &count, NULL);
+    free(key);
+    free(ctx);
+
+    for (long t = 0; t < threadscount; ++t) {
+        if (pthread_create(&threads[t], NULL, avalanche_worker, &jobs[t])) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+    for (long t = 0; t < threadscount; ++t) {
+        pthread_join(threads[t], NULL);
+        if (t == 0) continue;
+        for (size_t x = 0; x < (size_t)in * out; ++x) jobs[0].flips[x] += jobs[t].flips[x];
+        if (cfg.bic) {
+            for (size_t x = 0; x < (size_t)in * out * out; ++x) jobs[0].pairs[x] += jobs[t].pairs[x];
+        }
+    }
+
+    const uint64_t *flips = jobs[0].flips;
+    double n = (double)samples;
+
+    // input bits that never flip any output bit (e.g. the DES parity bits, the
+    // unused high half of a feistel key) are left out of the summaries
+    uint8_t *active = (uint8_t *)calloc(in, 1);
+    uint32_t active_count = 0;
+    for (uint32_t i = 0; i < in; ++i) {
+        for (uint32_t j = 0; j < out && !active[i]; ++j) active[i] = flips[i * out + j] != 0;
+        active_count += active[i];
+    }
+    // in key mode each group of 64 samples shares one key, so the number of
+    // distinct keys (not samples) bounds how well a P(flip) is estimated
+    double noise_n = n;
+    if (cfg.key_mode) {
+        noise_n = 0;
+        for (long t = 0; t < threadscount; ++t) noise_n += (double)((jobs[t].samples + AVALANCHE_GROUP - 1) / AVALANCHE_GROUP);
+    }
+
+    printf("cipher %s, rounds %u, %s bits flipped, %llu samples, %ld threads\n",
+        cfg.cipher->name, cfg.rounds, cfg.key_mode ? "key" : "plaintext", (unsigned long long)samples, threadscount);
+    if (active_count < in) {
+        printf("%u of %u input bits have no effect on the output:", in - active_count, in);
+        for (uint32_t i = 0; i < in; ++i) {
+            if (!active[i]) printf(" %u", i);
+        }
+        printf("\n");
+    }
+    if (active_count == 0) {
+        free(active);
+        return 0;
+    }
+
+    // avalanche: flipped output bits per input bit
+    double avg_min = out, avg_max = 0, avg_sum = 0;
+    for (uint32_t i = 0; i < in; ++i) {
+        if (!active[i]) continue;
+        double sum = 0;
+        for (uint32_t j = 0; j < out; ++j) sum += flips[i * out + j];
+        sum     /= n;
+        avg_sum += sum;
+        if (sum < avg_min) avg_min = sum;
+        if (sum > avg_max) avg_max = sum;
+    }
+    printf("avalanche: %.3f of %u output bits flip on average (min %.3f, max %.3f per input bit, ideal %.1f)\n",
+        avg_sum / active_count, out, avg_min, avg_max, out / 2.0);
+
+    // strict avalanche criterion
+    double sac_max = 0, sac_sum = 0;
+    for (uint32_t x = 0; x < in * out; ++x) {
+        if (!active[x / out]) continue;
+        double dev = fabs(flips[x] / n - 0.5);
+        sac_sum += dev;
+        if (dev > sac_max) sac_max = dev;
+    }
+    printf("SAC: mean |p - 0.5| = %.4f, max |p - 0.5| = %.4f (sampling noise ~ %.4f%s)\n",
+        sac_sum / ((double)active_count * out), sac_max, 0.5 / sqrt(noise_n),
+        cfg.key_mode ? " over the distinct keys" : "");
+
+    // bit independence criterion
+    if (cfg.bic) {
+        double bic_max = 0, bic_sum = 0;
+        uint64_t bic_count = 0;
+        for (uint32_t i = 0; i < in; ++i) {
+            if (!active[i]) continue;
+            for (uint32_t j = 0; j < out; ++j) {
+                for (uint32_t k = j + 1; k < out; ++k) {
+                    double pj  = flips[i * out + j] / n;
+                    double pk  = flips[i * out + k] / n;
+                    double pjk = jobs[0].pairs[((size_t)i * out + j) * out + k] / n;
+                    double var = pj * (1 - pj) * pk * (1 - pk);
+                    // an output bit that never (or always) flips is fully dependent
+                    double corr = var > 0 ? fabs(pjk - pj * pk) / sqrt(var) : 1.0;
+                    bic_sum += corr;
+                    bic_count++;
+                    if (corr > bic_max) bic_max = corr;
+                }
+            }
+        }
+        printf("BIC: mean |corr| = %.4f, max |corr| = %.4f\n", bic_sum / bic_count, bic_max);
+    }
+
+    if (matrix) {
+        printf("SAC matrix (row = input bit, column = output bit, P(flip) in percent)\n");
+        for (uint32_t i = 0; i < in; ++i) {
+            for (uint32_t j = 0; j < out; ++j) printf("%3.0f", 100 * flips[i * out + j] / n);
+            printf("\n");
+        }
+    }
+
+    free(active);
+    for (long t = 0; t < threadscount; ++t) {
+        free(jobs[t].flips);
+        free(jobs[t].pairs);
+    }
+    free(jobs);
+    free(threads);
+    return 0;
+}
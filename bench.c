@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DISPATCH_IMPL
+#define CIPHER_IMPL
+#define MODES_IMPL
+#define SPNET_IMPL
+#define FEISTEL_SPNET_IMPL
+#define DES_IMPL
+#define PERF_IMPL
+
+#include "dispatch.h"
+#include "cipher.h"
+#include "modes.h"
+#include "ciphers/spnet.h"
+#include "ciphers/feistel_spnet.h"
+#include "ciphers/des.h"
+#include "perf.h"
+
+// usage: ./bench.out [--perf] [--bytes N] [cipher ...]
+//   --perf   also count cycles, instructions, L1D misses and branch misses per item
+
+#define BENCH_MIN_NS 200000000ULL // repeat every benchmark for at least 0.2 s
+
+typedef struct {
+    const cipher_desc_t *cipher;
+    void *ctx;
+    void *mac_ctx;    // second key for the encrypt-then-mac benchmark
+    void *ctxs;       // MODES_KEY_BATCH contexts for the key setup benchmarks
+    uint8_t *out;
+    const uint8_t *in;
+    uint32_t blockscount;
+} bench_args_t;
+
+typedef struct {
+    const char *name;
+    uint32_t (*run)(const bench_args_t *a); // returns the number of items processed
+} bench_t;
+
+static uint32_t bench_block(const bench_args_t *a) {
+    uint32_t bs = a->cipher->blocksize;
+    for (uint32_t i = 0; i < a->blockscount; ++i) {
+        a->cipher->enc(a->ctx, a->out + i * bs, a->in + i * bs);
+    }
+    return a->blockscount;
+}
+
+static uint32_t bench_ecb_enc(const bench_args_t *a) {
+    ecb_enc(a->cipher, a->ctx, a->out, a->in, a->blockscount);
+    return a->blockscount;
+}
+
+static uint32_t bench_cbc_enc(const bench_args_t *a) {
+    cbc_enc(a->cipher, a->ctx, a->out, a->in, a->blockscount, a->in);
+    return a->blockscount;
+}
+
+// the same cbc encryption as a resumable job in 50 us slices (event loop use)
+static uint32_t bench_cbc_enc_job(const bench_args_t *a) {
+    mode_job_t job;
+    mode_job_init(&job, a->cipher, a->ctx, MODES_CBC_ENC, a->out, a->in, a->blockscount, a->in);
+    while (!mode_job_step(&job, 0, 50000)) {}
+    return a->blockscount;
+}
+
+// encryption and cbc-mac in one pass, under two different keys
+static uint32_t bench_cbc_enc_mac(const bench_args_t *a) {
+    uint8_t tag[CIPHER_MAX_BLOCKSIZE];
+    cbc_enc_mac(a->cipher, a->ctx, a->mac_ctx, a->out, a->in, a->blockscount, a->in, tag);
+    return a->blockscount;
+}
+
+static uint32_t bench_cbc_dec(const bench_args_t *a) {
+    cbc_dec(a->cipher, a->ctx, a->out, a->in, a->blockscount, a->in);
+    return a->blockscount;
+}
+
+static uint32_t bench_cfb_dec(const bench_args_t *a) {
+    cfb_dec(a->cipher, a->ctx, a->out, a->in, a->blockscount, a->in);
+    return a->blockscount;
+}
+
+// key setup, items are keys (taken from the input buffer)
+static uint32_t bench_setkey(const bench_args_t *a) {
+    uint32_t keys = a->blockscount * a->cipher->blocksize / a->cipher->keysize;
+    for (uint32_t i = 0; i < keys; ++i) {
+        uint8_t *ctx = (uint8_t *)a->ctxs + (size_t)(i % MODES_KEY_BATCH) * a->cipher->ctxsize;
+        a->cipher->setkey(ctx, a->in + (size_t)i * a->cipher->keysize, a->cipher->default_rounds);
+    }
+    return keys;
+}
+
+static uint32_t bench_setkey_batch(const bench_args_t *a) {
+    uint32_t keys = a->blockscount * a->cipher->blocksize / a->cipher->keysize;
+    for (uint32_t i = 0; i < keys; i += MODES_KEY_BATCH) {
+        uint32_t count = keys - i < MODES_KEY_BATCH ? keys - i : MODES_KEY_BATCH;
+        cipher_setkey_batch(a->cipher, a->ctxs, a->in + (size_t)i * a->cipher->keysize, count, a->cipher->default_rounds);
+    }
+    return keys;
+}
+
+static const bench_t benches[] = {
+    {"block",        bench_block},
+    {"ecb_enc",      bench_ecb_enc},
+    {"cbc_enc",      bench_cbc_enc},
+    {"cbc_enc_job",  bench_cbc_enc_job},
+    {"cbc_enc_mac",  bench_cbc_enc_mac},
+    {"cbc_dec",      bench_cbc_dec},
+    {"cfb_dec",      bench_cfb_dec},
+    {"setkey",       bench_setkey},
+    {"setkey_batch", bench_setkey_batch},
+};
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_print_counter(const perf_t *p, perf_counter_t counter, double items) {
+    if (perf_valid(p, counter)) printf(" %13.2f", p->values[counter] / items);
+    else                        printf(" %13s", "-");
+}
+
+static void bench_run(const bench_t *bench, const bench_args_t *args, perf_t *p, int use_perf) {
+    bench->run(args); // warm up caches and resolve the dispatched kernels
+
+    uint64_t items = 0, runs = 0;
+    if (use_perf) perf_start(p);
+    uint64_t start = bench_now_ns(), elapsed = 0;
+    while (elapsed < BENCH_MIN_NS || runs == 0) {
+        items   += bench->run(args);
+        runs    += 1;
+        elapsed = bench_now_ns() - start;
+    }
+    if (use_perf) perf_stop(p);
+
+    printf("%-16s %-13s %10.2f", args->cipher->name, bench->name, (double)elapsed / items);
+    if (use_perf) {
+        bench_print_counter(p, PERF_CYCLES, items);
+        bench_print_counter(p, PERF_INSTRUCTIONS, items);
+        if (perf_valid(p, PERF_CYCLES) && perf_valid(p, PERF_INSTRUCTIONS) && p->values[PERF_CYCLES]) {
+            printf(" %6.2f", (double)p->values[PERF_INSTRUCTIONS] / p->values[PERF_CYCLES]);
+        } else {
+            printf(" %6s", "-");
+        }
+        bench_print_counter(p, PERF_L1D_MISSES, items);
+        bench_print_counter(p, PERF_BRANCH_MISSES, items);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    int use_perf   = 0;
+    uint32_t bytes = 1 << 16;
+    const char *selected[16];
+    int selectedcount = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--perf")) use_perf = 1;
+        else if (!strcmp(argv[i], "--bytes") && i + 1 < argc) bytes = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (selectedcount < 16) selected[selectedcount++] = argv[i];
+    }
+
+    cipher_register(&SP_net32_cipher);
+    cipher_register(&feistel_SP_net32_cipher);
+    cipher_register(&des_cipher);
+
+    for (int s = 0; s < selectedcount; ++s) {
+        if (!cipher_find(selected[s])) {
+            fprintf(stderr, "unknown cipher %s\n", selected[s]);
+            return 1;
+        }
+    }
+    // every bench needs at least one block and one key
+    for (uint32_t c = 0; c < cipher_count(); ++c) {
+        const cipher_desc_t *cipher = cipher_get(c);
+        int wanted = selectedcount == 0;
+        for (int s = 0; s < selectedcount; ++s) wanted |= !strcmp(selected[s], cipher->name);
+        if (wanted && (bytes < cipher->blocksize || bytes < cipher->keysize)) {
+            fprintf(stderr, "--bytes %u is less than a %s block or key\n", bytes, cipher->name);
+            return 1;
+        }
+    }
+
+    perf_t p;
+    if (use_perf) {
+        int opened = perf_open(&p);
+        if (opened == 0) {
+            fprintf(stderr, "perf counters are not available here (perf_event_paranoid, container or non-Linux host), timing only\n");
+            use_perf = 0;
+        } else if (opened < PERF_COUNTERS) {
+            fprintf(stderr, "only %d of %d perf counters are available, the rest are shown as -\n", opened, PERF_COUNTERS);
+        }
+    }
+
+    uint8_t *in  = (uint8_t *)malloc(bytes);
+    uint8_t *out = (uint8_t *)malloc(bytes);
+    for (uint32_t i = 0; i < bytes; ++i) in[i] = (uint8_t)(i * 131 + 7);
+
+    printf("%-16s %-13s %10s", "cipher", "bench", "ns/item");
+    if (use_perf) printf(" %13s %13s %6s %13s %13s", "cycles/item", "instr/item", "ipc", "l1d-miss/item", "br-miss/item");
+    printf("\n");
+
+    for (uint32_t c = 0; c < cipher_count(); ++c) {
+        const cipher_desc_t *cipher = cipher_get(c);
+        int wanted = selectedcount == 0;
+        for (int s = 0; s < selectedcount; ++s) wanted |= !strcmp(selected[s], cipher->name);
+        if (!wanted) continue;
+
+        bench_args_t args;
+        args.cipher      = cipher;
+        args.ctx         = malloc(cipher->ctxsize);
+        args.mac_ctx     = malloc(cipher->ctxsize);
+        args.ctxs        = malloc((size_t)MODES_KEY_BATCH * cipher->ctxsize);
+        args.out         = out;
+        args.in          = in;
+        args.blockscount = bytes / cipher->blocksize;
+        cipher->setkey(args.ctx, in, cipher->default_rounds);
+
+        // mac key: a fixed pattern unrelated to the encryption key (not its complement, a des related key)
+        uint8_t *mac_key = (uint8_t *)malloc(cipher->keysize);
+        for (uint32_t i = 0; i < cipher->keysize; ++i) mac_key[i] = (uint8_t)(0x5C ^ i);
+        cipher->setkey(args.mac_ctx, mac_key, cipher->default_rounds);
+        free(mac_key);
+
+        for (uint32_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b) {
+            bench_run(&benches[b], &args, &p, use_perf);
+        }
+        free(args.ctx);
+        free(args.mac_ctx);
+        free(args.ctxs);
+    }
+
+    if (use_perf) perf_close(&p);
+    dispatch_report(stdout);
+    free(in);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,237 @@
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dispatch.h"
+
+// CIPHER_IMPL compiles the implementation (and dispatch.h's); MODES_IMPL and
+// the cipher *_IMPL macros define it too unless CRYPTO_EXTERN_DEPS is set
+
+// largest block the mode layer has to buffer (128-bit ciphers)
+#define CIPHER_MAX_BLOCKSIZE  16
+#define CIPHER_MAX_REGISTERED 32
+
+// full unrolling of loops with a compile-time trip count (fixed-round specializations)
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8
+#define CIPHER_UNROLL _Pragma("GCC unroll 64")
+#elif defined(__clang__)
+#define CIPHER_UNROLL _Pragma("unroll")
+#else
+#define CIPHER_UNROLL
+#endif
+
+// blocks and keys are byte buffers of blocksize/keysize bytes,
+// the integer ciphers read and write them in host byte order
+typedef void (*cipher_setkey_func_t)(void *ctx, const uint8_t *key, uint32_t rounds);
+typedef void (*cipher_setkey_batch_func_t)(void *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+typedef void (*cipher_block_func_t)(const void *ctx, uint8_t *out, const uint8_t *in);
+typedef void (*cipher_batch_func_t)(const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount);
+
+typedef struct {
+    const char *name;
+    uint32_t blocksize;      // bytes
+    uint32_t keysize;        // bytes
+    uint32_t ctxsize;        // bytes of the expanded key (what setkey fills)
+    uint32_t default_rounds;
+    cipher_setkey_func_t setkey;
+    cipher_setkey_batch_func_t setkey_batch; // optional, NULL = loop over setkey
+    cipher_block_func_t  enc;
+    cipher_block_func_t  dec;
+    cipher_batch_func_t  enc_batch; // optional, NULL = loop over enc
+    cipher_batch_func_t  dec_batch; // optional, NULL = loop over dec
+} cipher_desc_t;
+
+// expands count keys (keysize bytes each) into count contexts of ctxsize bytes each
+void cipher_setkey_batch(const cipher_desc_t *cipher, void *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+
+// out may be equal to in
+void cipher_enc_batch(const cipher_desc_t *cipher, const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount);
+void cipher_dec_batch(const cipher_desc_t *cipher, const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount);
+
+// dst = a ^ b, dst may be equal to a or b; long buffers use the best simd kernel (dispatch.h)
+void cipher_xor(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len);
+
+// 64x64 bit matrix transpose in place: bit j of a[k] <-> bit k of a[j]
+// (turns 64 words into 64 bit-planes and back, for bitsliced code)
+void cipher_transpose64(uint64_t *a);
+
+// registry: tools register the ciphers they are built with and look them up by name
+int cipher_register(const cipher_desc_t *cipher);
+const cipher_desc_t *cipher_find(const char *name);
+uint32_t cipher_count(void);
+const cipher_desc_t *cipher_get(uint32_t i);
+
+#endif
+
+// own guard: modes.h and the cipher headers include this file again with CIPHER_IMPL
+#if defined(CIPHER_IMPL) && !defined(CIPHER_IMPL_DONE)
+#define CIPHER_IMPL_DONE
+
+// cpu detection for the xor kernels (see CRYPTO_EXTERN_DEPS in README.md)
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef DISPATCH_IMPL
+#define DISPATCH_IMPL
+#endif
+#include "dispatch.h"
+#endif
+
+#include <string.h>
+
+#if DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+static const cipher_desc_t *cipher_registry[CIPHER_MAX_REGISTERED];
+static uint32_t cipher_registry_count = 0;
+
+void cipher_setkey_batch(const cipher_desc_t *cipher, void *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    if (cipher->setkey_batch) {
+        cipher->setkey_batch(ctxs, keys, count, rounds);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        cipher->setkey((uint8_t *)ctxs + i * cipher->ctxsize, keys + i * cipher->keysize, rounds);
+    }
+}
+
+void cipher_enc_batch(const cipher_desc_t *cipher, const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    if (cipher->enc_batch) {
+        cipher->enc_batch(ctx, out, in, blockscount);
+        return;
+    }
+    for (size_t i = 0; i < blockscount; ++i) {
+        cipher->enc(ctx, out + i * cipher->blocksize, in + i * cipher->blocksize);
+    }
+}
+
+void cipher_dec_batch(const cipher_desc_t *cipher, const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    if (cipher->dec_batch) {
+        cipher->dec_batch(ctx, out, in, blockscount);
+        return;
+    }
+    for (size_t i = 0; i < blockscount; ++i) {
+        cipher->dec(ctx, out + i * cipher->blocksize, in + i * cipher->blocksize);
+    }
+}
+
+typedef void (*cipher_xor_kernel_t)(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len);
+
+static void cipher_xor_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        x ^= y;
+        memcpy(dst + i, &x, 8);
+    }
+    for (; i < len; ++i) {
+        dst[i] = a[i] ^ b[i];
+    }
+}
+
+#if DISPATCH_X86
+
+DISPATCH_TARGET("sse2")
+static void cipher_xor_sse2(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(x, y));
+    }
+    cipher_xor_scalar(dst + i, a + i, b + i, len - i);
+}
+
+DISPATCH_TARGET("avx2")
+static void cipher_xor_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(x, y));
+    }
+    cipher_xor_scalar(dst + i, a + i, b + i, len - i);
+}
+
+DISPATCH_TARGET("avx512f")
+static void cipher_xor_avx512(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void *)(a + i));
+        __m512i y = _mm512_loadu_si512((const void *)(b + i));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_xor_si512(x, y));
+    }
+    cipher_xor_scalar(dst + i, a + i, b + i, len - i);
+}
+
+#endif
+
+static void cipher_xor_resolve(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len);
+static cipher_xor_kernel_t cipher_xor_kernel = cipher_xor_resolve;
+
+// first call picks the kernel for this cpu and replaces itself
+static void cipher_xor_resolve(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
+    dispatch_level_t level     = dispatch_level();
+    dispatch_level_t chosen    = DISPATCH_SCALAR;
+    cipher_xor_kernel_t kernel = cipher_xor_scalar;
+#if DISPATCH_X86
+    if (level >= DISPATCH_AVX512)    { kernel = cipher_xor_avx512; chosen = DISPATCH_AVX512; }
+    else if (level >= DISPATCH_AVX2) { kernel = cipher_xor_avx2;   chosen = DISPATCH_AVX2;   }
+    else if (level >= DISPATCH_SSE2) { kernel = cipher_xor_sse2;   chosen = DISPATCH_SSE2;   }
+#else
+    (void)level;
+#endif
+    dispatch_note("cipher_xor", chosen);
+    DISPATCH_STORE(cipher_xor_kernel, kernel);
+    kernel(dst, a, b, len);
+}
+
+void cipher_xor(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t len) {
+    // a single block is too short to be worth an indirect call
+    if (len <= CIPHER_MAX_BLOCKSIZE) {
+        for (size_t i = 0; i < len; ++i) {
+            dst[i] = a[i] ^ b[i];
+        }
+        return;
+    }
+    DISPATCH_LOAD(cipher_xor_kernel)(dst, a, b, len);
+}
+
+void cipher_transpose64(uint64_t *a) {
+    uint64_t m = 0x00000000FFFFFFFFULL;
+    for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+        for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            uint64_t t  = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k]        ^= t << j;
+            a[k | j]    ^= t;
+        }
+    }
+}
+
+// returns 0 on success, -1 if the registry is full or the name is taken
+int cipher_register(const cipher_desc_t *cipher) {
+    if (cipher_find(cipher->name)) return -1;
+    if (cipher_registry_count == CIPHER_MAX_REGISTERED) return -1;
+    cipher_registry[cipher_registry_count++] = cipher;
+    return 0;
+}
+
+const cipher_desc_t *cipher_find(const char *name) {
+    for (uint32_t i = 0; i < cipher_registry_count; ++i) {
+        if (!strcmp(cipher_registry[i]->name, name)) return cipher_registry[i];
+    }
+    return NULL;
+}
+
+uint32_t cipher_count(void) {
+    return cipher_registry_count;
+}
+
+const cipher_desc_t *cipher_get(uint32_t i) {
+    return i < cipher_registry_count ? cipher_registry[i] : NULL;
+}
+
+#endif
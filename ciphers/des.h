@@ -1,14 +1,44 @@
 #ifndef DES_H
 #define DES_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "../cipher.h"
+
+#define DES_ROUNDS 16
+
+// expanded key, filled once by des_init and reused for every block
+typedef struct {
+    uint64_t roundkeys[DES_ROUNDS];
+} des_ctx_t;
 
 uint64_t des_enc(uint64_t block, uint64_t masterkey, uint32_t rounds);
 uint64_t des_dec(uint64_t block, uint64_t masterkey, uint32_t rounds);
 
+void des_init(des_ctx_t *ctx, uint64_t masterkey, uint32_t rounds);
+// expands count keys at once (bitsliced, 64 keys per pass), for data where every record has its own key
+void des_init_batch(des_ctx_t *ctxs, const uint64_t *masterkeys, size_t count, uint32_t rounds);
+uint64_t des_enc_block(const des_ctx_t *ctx, uint64_t block);
+uint64_t des_dec_block(const des_ctx_t *ctx, uint64_t block);
+// S-box box (0..7) of the round function: 6 bits in, 4 bits out (for table analysis)
+uint8_t des_sbox(uint32_t box, uint32_t six_bits);
+
+// descriptor for the generic mode layer, name "des"
+extern const cipher_desc_t des_cipher;
+
 #ifdef DES_IMPL
 
+// cipher_transpose64 for the bitsliced key schedule
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef CIPHER_IMPL
+#define CIPHER_IMPL
+#endif
+#include "../cipher.h"
+#endif
+
 #define DES_MASK6  ((1ULL << 6)  - 1)
 #define DES_MASK28 ((1ULL << 28) - 1)
 #define DES_MASK32 ((1ULL << 32) - 1)
@@ -49,30 +79,30 @@ static uint64_t des_do_permutation(uint64_t bits, uint64_t bits_count, uint64_t
     return res;
 }
 
-static void des_generate_round_keys(uint64_t masterkey, uint64_t *roundkeys, uint32_t rounds) {
-    // tables using in generation round keys from standard
-    static const uint64_t des_key_permutation_table[56] = {
-        57, 49, 41, 33, 25, 17, 9 , 1 ,
-        58, 50, 42, 34, 26, 18, 10, 2 ,
-        59, 51, 43, 35, 27, 19, 11, 3 ,
-        60, 52, 44, 36, 63, 55, 47, 39,
-        31, 23, 15, 7 , 62, 54, 46, 38,
-        30, 22, 14, 6 , 61, 53, 45, 37,
-        29, 21, 13, 5 , 28, 20, 12, 4 ,
-    };
-    static const uint64_t des_key_compression_table[48] = {
-        14, 17, 11, 24, 1 , 5 , 3 , 28,
-        15, 6 , 21, 10, 23, 19, 12, 4 ,
-        26, 8 , 16, 7 , 27, 20, 13, 2 ,
-        41, 52, 31, 37, 47, 55, 30, 40,
-        51, 45, 33, 48, 44, 49, 39, 56,
-        34, 53, 46, 42, 50, 36, 29, 32,
-    };
-    static const uint64_t des_key_shifts[16] = {
-        1 , 1 , 2 , 2 , 2 , 2 , 2 , 2 ,
-        1 , 2 , 2 , 2 , 2 , 2 , 2 , 1 ,
-    };
+// tables using in generation round keys from standard
+static const uint64_t des_key_permutation_table[56] = {
+    57, 49, 41, 33, 25, 17, 9 , 1 ,
+    58, 50, 42, 34, 26, 18, 10, 2 ,
+    59, 51, 43, 35, 27, 19, 11, 3 ,
+    60, 52, 44, 36, 63, 55, 47, 39,
+    31, 23, 15, 7 , 62, 54, 46, 38,
+    30, 22, 14, 6 , 61, 53, 45, 37,
+    29, 21, 13, 5 , 28, 20, 12, 4 ,
+};
+static const uint64_t des_key_compression_table[48] = {
+    14, 17, 11, 24, 1 , 5 , 3 , 28,
+    15, 6 , 21, 10, 23, 19, 12, 4 ,
+    26, 8 , 16, 7 , 27, 20, 13, 2 ,
+    41, 52, 31, 37, 47, 55, 30, 40,
+    51, 45, 33, 48, 44, 49, 39, 56,
+    34, 53, 46, 42, 50, 36, 29, 32,
+};
+static const uint64_t des_key_shifts[16] = {
+    1 , 1 , 2 , 2 , 2 , 2 , 2 , 2 ,
+    1 , 2 , 2 , 2 , 2 , 2 , 2 , 1 ,
+};
 
+static void des_generate_round_keys(uint64_t masterkey, uint64_t *roundkeys, uint32_t rounds) {
     /* 1. A 56-bit key arrives (in DES it's stored in a 64-bit container where every 8th bit is a parity bit.
     This is for error detection, like integrity control. But I'll just use the lower 56 bits in a 64-bit container) */    
     masterkey &= DES_MASK56;
@@ -99,6 +129,115 @@ static void des_generate_round_keys(uint64_t masterkey, uint64_t *roundkeys, uin
     }
 }
 
+/* Batched key schedule. Every round key bit is just some bit of the master key
+(PC-1, the rotations and PC-2 only move bits), so for 64 keys at once:
+transpose them into 64 bit-planes (plane j = bit j of every key), pick the
+planes of each round key bit and transpose back */
+
+// des_key_bit_source[r][i] = master key bit that becomes bit i of round key r
+static void des_key_bit_sources(uint8_t sources[DES_ROUNDS][48]) {
+    uint8_t permuted[56];
+    for (int i = 0; i < 56; ++i) {
+        permuted[i] = (des_key_permutation_table[i] - 1) % 56;
+    }
+    uint32_t shift = 0;
+    for (int r = 0; r < DES_ROUNDS; ++r) {
+        shift += des_key_shifts[r];
+        for (int i = 0; i < 48; ++i) {
+            // bit of the rotated (left << 28 | right) word, then back to the unrotated one
+            int bit  = (des_key_compression_table[i] - 1) % 56;
+            int half = bit < 28 ? 0 : 28;
+            sources[r][i] = permuted[half + (bit - half + 28 - shift % 28) % 28];
+        }
+    }
+}
+
+void des_init_batch(des_ctx_t *ctxs, const uint64_t *masterkeys, size_t count, uint32_t rounds) {
+    if (rounds != DES_ROUNDS) {
+        fprintf(stderr, "des need 16 rounds (standard)\n");
+        exit(1);
+    }
+    uint8_t sources[DES_ROUNDS][48];
+    des_key_bit_sources(sources);
+
+    uint64_t planes[64], roundkeys[64];
+    for (size_t first = 0; first < count; first += 64) {
+        size_t n = count - first < 64 ? count - first : 64;
+        memset(planes, 0, sizeof(planes));
+        memcpy(planes, masterkeys + first, n * sizeof(uint64_t));
+        cipher_transpose64(planes);
+
+        for (int r = 0; r < DES_ROUNDS; ++r) {
+            memset(roundkeys + 48, 0, 16 * sizeof(uint64_t));
+            for (int i = 0; i < 48; ++i) {
+                roundkeys[i] = planes[sources[r][i]];
+            }
+            cipher_transpose64(roundkeys);
+            for (size_t k = 0; k < n; ++k) {
+                ctxs[first + k].roundkeys[r] = roundkeys[k];
+            }
+        }
+    }
+}
+
+// Narrowing S-boxes from the standard
+static const uint8_t des_s_blocks[8][4][16] = {
+    {
+        {14, 4 , 13, 1 , 2 , 15, 11, 8 , 3 , 10, 6 , 12, 5 , 9 , 0 , 7 },
+        {0 , 15, 7 , 4 , 14, 2 , 13, 1 , 10, 6 , 12, 11, 9 , 5 , 3 , 8 },
+        {4 , 1 , 14, 8 , 13, 6 , 2 , 11, 15, 12, 9 , 7 , 3 , 10, 5 , 0 },
+        {15, 12, 8 , 2 , 4 , 9 , 1 , 7 , 5 , 11, 3 , 14, 10, 0 , 6 , 13},
+    },
+    {
+        {15, 1 , 8 , 14, 6 , 11, 3 , 4 , 9 , 7 , 2 , 13, 12, 0 , 5 , 10},
+        {3 , 13, 4 , 7 , 15, 2 , 8 , 14, 12, 0 , 1 , 10, 6 , 9 , 11, 5 },
+        {0 , 14, 7 , 11, 10, 4 , 13, 1 , 5 , 8 , 12, 6 , 9 , 3 , 2 , 15},
+        {13, 8 , 10, 1 , 3 , 15, 4 , 2 , 11, 6 , 7 , 12, 0 , 5 , 14, 9 },
+    },
+    {
+        {10, 0 , 9 , 14, 6 , 3 , 15, 5 , 1 , 13, 12, 7 , 11, 4 , 2 , 8 },
+        {13, 7 , 0 , 9 , 3 , 4 , 6 , 10, 2 , 8 , 5 , 14, 12, 11, 15, 1 },
+        {13, 6 , 4 , 9 , 8 , 15, 3 , 0 , 11, 1 , 2 , 12, 5 , 10, 14, 7 },
+        {1 , 10, 13, 0 , 6 , 9 , 8 , 7 , 4 , 15, 14, 3 , 11, 5 , 2 , 12},
+    },
+    {
+        {7 , 13, 14, 3 , 0 , 6 , 9 , 10, 1 , 2 , 8 , 5 , 11, 12, 4 , 15},
+        {13, 8 , 11, 5 , 6 , 15, 0 , 3 , 4 , 7 , 2 , 12, 1 , 10, 14, 9 },
+        {10, 6 , 9 , 0 , 12, 11, 7 , 13, 15, 1 , 3 , 14, 5 , 2 , 8 , 4 },
+        {3 , 15, 0 , 6 , 10, 1 , 13, 8 , 9 , 4 , 5 , 11, 12, 7 , 2 , 14},
+    },
+    {
+        {2 , 12, 4 , 1 , 7 , 10, 11, 6 , 8 , 5 , 3 , 15, 13, 0 , 14, 9 },
+        {14, 11, 2 , 12, 4 , 7 , 13, 1 , 5 , 0 , 15, 10, 3 , 9 , 8 , 6 },
+        {4 , 2 , 1 , 11, 10, 13, 7 , 8 , 15, 9 , 12, 5 , 6 , 3 , 0 , 14},
+        {11, 8 , 12, 7 , 1 , 14, 2 , 13, 6 , 15, 0 , 9 , 10, 4 , 5 , 3 }
+    },
+    {
+        {12, 1 , 10, 15, 9 , 2 , 6 , 8 , 0 , 13, 3 , 4 , 14, 7 , 5 , 11},
+        {10, 15, 4 , 2 , 7 , 12, 9 , 5 , 6 , 1 , 13, 14, 0 , 11, 3 , 8 },
+        {9 , 14, 15, 5 , 2 , 8 , 12, 3 , 7 , 0 , 4 , 10, 1 , 13, 11, 6 },
+        {4 , 3 , 2 , 12, 9 , 5 , 15, 10, 11, 14, 1 , 7 , 6 , 0 , 8 , 13},
+    },
+    {
+        {4 , 11, 2 , 14, 15, 0 , 8 , 13, 3 , 12, 9 , 7 , 5 , 10, 6 , 1 },
+        {13, 0 , 11, 7 , 4 , 9 , 1 , 10, 14, 3 , 5 , 12, 2 , 15, 8 , 6 },
+        {1 , 4 , 11, 13, 12, 3 , 7 , 14, 10, 15, 6 , 8 , 0 , 5 , 9 , 2 },
+        {6 , 11, 13, 8 , 1 , 4 , 10, 7 , 9 , 5 , 0 , 15, 14, 2 , 3 , 12},
+    },
+    {
+        {13, 2 , 8 , 4 , 6 , 15, 11, 1 , 10, 9 , 3 , 14, 5 , 0 , 12, 7 },
+        {1 , 15, 13, 8 , 10, 3 , 7 , 4 , 12, 5 , 6 , 11, 0 , 14, 9 , 2 },
+        {7 , 11, 4 , 1 , 9 , 12, 14, 2 , 0 , 6 , 10, 13, 15, 3 , 5 , 8 },
+        {2 , 1 , 14, 7 , 4 , 10, 8 , 13, 15, 12, 9 , 0 , 3 , 5 , 6 , 11},
+    }
+};
+
+uint8_t des_sbox(uint32_t box, uint32_t six_bits) {
+    uint8_t row = ((six_bits & 0x20) >> 4) | (six_bits & 0x01);
+    uint8_t col = (six_bits >> 1) & 0x0F;
+    return des_s_blocks[box][row][col];
+}
+
 static uint32_t _des_round_encdec(uint32_t block, uint64_t roundkey) {
     // 1. The round function receives a 32-bit half-block
     // 2. A fixed expansion permutation is applied to it, resulting in a 48-bit value
@@ -119,66 +258,10 @@ static uint32_t _des_round_encdec(uint32_t block, uint64_t roundkey) {
     state ^= roundkey;
 
     /* 4. The resulting 48-bit word is split into 8 fragments of 6 bits each,
-    which pass through narrowing S-boxes and are transformed into 4-bit words
-    
-    Narrowing S-boxes from the standard */
-    static const uint8_t des_s_blocks[8][4][16] = {
-        {
-            {14, 4 , 13, 1 , 2 , 15, 11, 8 , 3 , 10, 6 , 12, 5 , 9 , 0 , 7 },
-            {0 , 15, 7 , 4 , 14, 2 , 13, 1 , 10, 6 , 12, 11, 9 , 5 , 3 , 8 },
-            {4 , 1 , 14, 8 , 13, 6 , 2 , 11, 15, 12, 9 , 7 , 3 , 10, 5 , 0 },
-            {15, 12, 8 , 2 , 4 , 9 , 1 , 7 , 5 , 11, 3 , 14, 10, 0 , 6 , 13},
-        },
-        {
-            {15, 1 , 8 , 14, 6 , 11, 3 , 4 , 9 , 7 , 2 , 13, 12, 0 , 5 , 10},
-            {3 , 13, 4 , 7 , 15, 2 , 8 , 14, 12, 0 , 1 , 10, 6 , 9 , 11, 5 },
-            {0 , 14, 7 , 11, 10, 4 , 13, 1 , 5 , 8 , 12, 6 , 9 , 3 , 2 , 15},
-            {13, 8 , 10, 1 , 3 , 15, 4 , 2 , 11, 6 , 7 , 12, 0 , 5 , 14, 9 },
-        },
-        {
-            {10, 0 , 9 , 14, 6 , 3 , 15, 5 , 1 , 13, 12, 7 , 11, 4 , 2 , 8 },
-            {13, 7 , 0 , 9 , 3 , 4 , 6 , 10, 2 , 8 , 5 , 14, 12, 11, 15, 1 },
-            {13, 6 , 4 , 9 , 8 , 15, 3 , 0 , 11, 1 , 2 , 12, 5 , 10, 14, 7 },
-            {1 , 10, 13, 0 , 6 , 9 , 8 , 7 , 4 , 15, 14, 3 , 11, 5 , 2 , 12},
-        },
-        {
-            {7 , 13, 14, 3 , 0 , 6 , 9 , 10, 1 , 2 , 8 , 5 , 11, 12, 4 , 15},
-            {13, 8 , 11, 5 , 6 , 15, 0 , 3 , 4 , 7 , 2 , 12, 1 , 10, 14, 9 },
-            {10, 6 , 9 , 0 , 12, 11, 7 , 13, 15, 1 , 3 , 14, 5 , 2 , 8 , 4 },
-            {3 , 15, 0 , 6 , 10, 1 , 13, 8 , 9 , 4 , 5 , 11, 12, 7 , 2 , 14},
-        },
-        {
-            {2 , 12, 4 , 1 , 7 , 10, 11, 6 , 8 , 5 , 3 , 15, 13, 0 , 14, 9 },
-            {14, 11, 2 , 12, 4 , 7 , 13, 1 , 5 , 0 , 15, 10, 3 , 9 , 8 , 6 },
-            {4 , 2 , 1 , 11, 10, 13, 7 , 8 , 15, 9 , 12, 5 , 6 , 3 , 0 , 14},
-            {11, 8 , 12, 7 , 1 , 14, 2 , 13, 6 , 15, 0 , 9 , 10, 4 , 5 , 3 }
-        },
-        {
-            {12, 1 , 10, 15, 9 , 2 , 6 , 8 , 0 , 13, 3 , 4 , 14, 7 , 5 , 11},
-            {10, 15, 4 , 2 , 7 , 12, 9 , 5 , 6 , 1 , 13, 14, 0 , 11, 3 , 8 },
-            {9 , 14, 15, 5 , 2 , 8 , 12, 3 , 7 , 0 , 4 , 10, 1 , 13, 11, 6 },
-            {4 , 3 , 2 , 12, 9 , 5 , 15, 10, 11, 14, 1 , 7 , 6 , 0 , 8 , 13},
-        },
-        {
-            {4 , 11, 2 , 14, 15, 0 , 8 , 13, 3 , 12, 9 , 7 , 5 , 10, 6 , 1 },
-            {13, 0 , 11, 7 , 4 , 9 , 1 , 10, 14, 3 , 5 , 12, 2 , 15, 8 , 6 },
-            {1 , 4 , 11, 13, 12, 3 , 7 , 14, 10, 15, 6 , 8 , 0 , 5 , 9 , 2 },
-            {6 , 11, 13, 8 , 1 , 4 , 10, 7 , 9 , 5 , 0 , 15, 14, 2 , 3 , 12},
-        },
-        {
-            {13, 2 , 8 , 4 , 6 , 15, 11, 1 , 10, 9 , 3 , 14, 5 , 0 , 12, 7 },
-            {1 , 15, 13, 8 , 10, 3 , 7 , 4 , 12, 5 , 6 , 11, 0 , 14, 9 , 2 },
-            {7 , 11, 4 , 1 , 9 , 12, 14, 2 , 0 , 6 , 10, 13, 15, 3 , 5 , 8 },
-            {2 , 1 , 14, 7 , 4 , 10, 8 , 13, 15, 12, 9 , 0 , 3 , 5 , 6 , 11},
-        }
-    };
-
+    which pass through narrowing S-boxes (des_s_blocks) and are transformed into 4-bit words */
     uint32_t res = 0;
     for (int i = 0; i < 8; ++i) {
-        uint8_t six_bits = (state >> (i * 6)) & DES_MASK6;
-        uint8_t row      = ((six_bits & 0x20) >> 4) | (six_bits & 0x01);
-        uint8_t col      = (six_bits >> 1) & 0x0F;
-        res              |= (des_s_blocks[i][row][col] << (i * 4));
+        res |= (uint32_t)des_sbox(i, (state >> (i * 6)) & DES_MASK6) << (i * 4);
     }
 
     // 5. Next follows a fixed P-block (just permutation)
@@ -215,51 +298,90 @@ static uint64_t des_tau(uint64_t block) {
     return ((uint64_t)right << 32) | left;
 }
 
+// des only has the 16-round specialization: round keys in a fixed array, unrolled rounds
 uint64_t des_enc(uint64_t block, uint64_t masterkey, uint32_t rounds) {
-    if (rounds != 16) {
+    des_ctx_t ctx;
+    des_init(&ctx, masterkey, rounds);
+    return des_enc_block(&ctx, block);
+}
+
+uint64_t des_dec(uint64_t block, uint64_t masterkey, uint32_t rounds) {
+    des_ctx_t ctx;
+    des_init(&ctx, masterkey, rounds);
+    return des_dec_block(&ctx, block);
+}
+
+void des_init(des_ctx_t *ctx, uint64_t masterkey, uint32_t rounds) {
+    if (rounds != DES_ROUNDS) {
         fprintf(stderr, "des need 16 rounds (standard)\n");
         exit(1);
     }
-    uint64_t *roundkeys = (uint64_t *)malloc(rounds*sizeof(uint64_t));
-    des_generate_round_keys(masterkey, roundkeys, rounds);
-
-    uint64_t state = block;
+    des_generate_round_keys(masterkey, ctx->roundkeys, DES_ROUNDS);
+}
 
-    state = des_do_permutation(state, 64, 64, des_initial_permutation_table);
-    
-    for (uint32_t i = 0; i < rounds; ++i) {
-        state = des_round_encdec(state, roundkeys[i]);
+uint64_t des_enc_block(const des_ctx_t *ctx, uint64_t block) {
+    uint64_t state = des_do_permutation(block, 64, 64, des_initial_permutation_table);
+    CIPHER_UNROLL
+    for (uint32_t i = 0; i < DES_ROUNDS; ++i) {
+        state = des_round_encdec(state, ctx->roundkeys[i]);
     }
     state = des_tau(state);
-    
-    state = des_do_permutation(state, 64, 64, des_final_permutation_table);
-    
-    free(roundkeys);
-    return state;
+    return des_do_permutation(state, 64, 64, des_final_permutation_table);
 }
 
-uint64_t des_dec(uint64_t block, uint64_t masterkey, uint32_t rounds) {
-    if (rounds != 16) {
-        fprintf(stderr, "des need 16 rounds (standard)\n");
-        exit(1);
+uint64_t des_dec_block(const des_ctx_t *ctx, uint64_t block) {
+    uint64_t state = des_do_permutation(block, 64, 64, des_initial_permutation_table);
+    CIPHER_UNROLL
+    for (int i = DES_ROUNDS-1; i >= 0; --i) {
+        state = des_round_encdec(state, ctx->roundkeys[i]);
     }
-    uint64_t *roundkeys = (uint64_t *)malloc(rounds*sizeof(uint64_t));
-    des_generate_round_keys(masterkey, roundkeys, rounds);
+    state = des_tau(state);
+    return des_do_permutation(state, 64, 64, des_final_permutation_table);
+}
 
-    uint64_t state = block;
+// descriptor glue: blocks and keys are 8 bytes in host order
+
+static void des_cipher_setkey(void *ctx, const uint8_t *key, uint32_t rounds) {
+    uint64_t masterkey;
+    memcpy(&masterkey, key, sizeof(masterkey));
+    des_init((des_ctx_t *)ctx, masterkey, rounds);
+}
 
-    state = des_do_permutation(state, 64, 64, des_initial_permutation_table);
-    for (int i = rounds-1; i >= 0; --i) {
-        state = des_round_encdec(state, roundkeys[i]);
+static void des_cipher_setkey_batch(void *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    uint64_t masterkeys[64];
+    for (size_t i = 0; i < count; i += 64) {
+        size_t n = count - i < 64 ? count - i : 64;
+        memcpy(masterkeys, keys + i * 8, n * 8);
+        des_init_batch((des_ctx_t *)ctxs + i, masterkeys, n, rounds);
     }
-    state = des_tau(state);
-    
-    state = des_do_permutation(state, 64, 64, des_final_permutation_table);
-    
-    free(roundkeys);
-    return state;
 }
 
+static void des_cipher_enc(const void *ctx, uint8_t *out, const uint8_t *in) {
+    uint64_t block;
+    memcpy(&block, in, sizeof(block));
+    block = des_enc_block((const des_ctx_t *)ctx, block);
+    memcpy(out, &block, sizeof(block));
+}
+
+static void des_cipher_dec(const void *ctx, uint8_t *out, const uint8_t *in) {
+    uint64_t block;
+    memcpy(&block, in, sizeof(block));
+    block = des_dec_block((const des_ctx_t *)ctx, block);
+    memcpy(out, &block, sizeof(block));
+}
+
+const cipher_desc_t des_cipher = {
+    .name           = "des",
+    .blocksize      = 8,
+    .keysize        = 8,
+    .ctxsize        = sizeof(des_ctx_t),
+    .default_rounds = DES_ROUNDS,
+    .setkey         = des_cipher_setkey,
+    .setkey_batch   = des_cipher_setkey_batch,
+    .enc            = des_cipher_enc,
+    .dec            = des_cipher_dec,
+};
+
 #endif
 
 #endif
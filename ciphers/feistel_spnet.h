@@ -1,16 +1,61 @@
 #ifndef FEISTEL_SPNET_H
 #define FEISTEL_SPNET_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "../cipher.h"
+
+#define FEISTEL_SP_NET32_MAX_ROUNDS 64
+
+// expanded key, filled once by feistel_SP_net32_init and reused for every block
+typedef struct {
+    uint32_t rounds;
+    uint16_t roundkeys[FEISTEL_SP_NET32_MAX_ROUNDS];
+} feistel_SP_net32_ctx_t;
+
+// runtime rounds; dispatches to the fixed-round versions below when one exists
 uint32_t feistel_SP_net32_enc(uint32_t block, uint32_t masterkey, uint32_t rounds);
 uint32_t feistel_SP_net32_dec(uint32_t block, uint32_t masterkey, uint32_t rounds);
 
+// round counts with a fully unrolled specialization: feistel_SP_net32_enc_r5, feistel_SP_net32_dec_r5, ...
+#define FEISTEL_SP_NET32_FIXED_ROUNDS(X) X(4) X(5) X(8) X(16)
+
+#define FEISTEL_SP_NET32_DECLARE_FIXED(R) \
+uint32_t feistel_SP_net32_enc_r##R(uint32_t block, uint32_t masterkey); \
+uint32_t feistel_SP_net32_dec_r##R(uint32_t block, uint32_t masterkey);
+FEISTEL_SP_NET32_FIXED_ROUNDS(FEISTEL_SP_NET32_DECLARE_FIXED)
+
+void feistel_SP_net32_init(feistel_SP_net32_ctx_t *ctx, uint32_t masterkey, uint32_t rounds);
+// expands count keys at once, for data where every record has its own key
+void feistel_SP_net32_init_batch(feistel_SP_net32_ctx_t *ctxs, const uint32_t *masterkeys, size_t count, uint32_t rounds);
+uint32_t feistel_SP_net32_enc_block(const feistel_SP_net32_ctx_t *ctx, uint32_t block);
+uint32_t feistel_SP_net32_dec_block(const feistel_SP_net32_ctx_t *ctx, uint32_t block);
+// the 16-bit round function F(right half, round key) (for table analysis)
+uint16_t feistel_SP_net32_round16(uint16_t block, uint16_t roundkey);
+
+// descriptor for the generic mode layer, name "feistel_spnet32"
+extern const cipher_desc_t feistel_SP_net32_cipher;
+
 #ifdef FEISTEL_SPNET_IMPL
 
+// descriptor helpers and the dispatch of the key schedule kernels
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef CIPHER_IMPL
+#define CIPHER_IMPL
+#endif
+#include "../cipher.h"
+#endif
+
+#if DISPATCH_X86
+#include <immintrin.h>
+#endif
+
 static uint32_t feistel_SP_net32_right_cycleshift32(uint32_t num, uint32_t shiftval) {
-    return (num >> (shiftval % 32)) | (num << (32 - (shiftval % 32)));
+    // (32 - shift) % 32: a shift by 0 must not become x << 32
+    return (num >> (shiftval % 32)) | (num << ((32 - shiftval % 32) % 32));
 }
 
 // 4bit fragments
@@ -62,6 +107,10 @@ static uint16_t feistel_SP_net32_SP_net16_round_enc(uint16_t block, uint16_t rou
     return res;
 }
 
+uint16_t feistel_SP_net32_round16(uint16_t block, uint16_t roundkey) {
+    return feistel_SP_net32_SP_net16_round_enc(block, roundkey);
+}
+
 // this substitution = tau = involutive substitution
 static uint32_t feistel_SP_net32_tau(uint32_t block) {
     uint16_t left  = block >> 16;
@@ -79,7 +128,46 @@ static uint32_t feistel_SP_net32_round_encdec(uint32_t block, uint16_t roundkey)
     return res;
 }
 
+/* Fixed-round specializations: round keys live in an R-sized array on the stack
+and the round loops have a constant trip count, so they are fully unrolled */
+#define FEISTEL_SP_NET32_DEFINE_FIXED(R) \
+static uint32_t feistel_SP_net32_enc_rounds_r##R(const uint16_t *roundkeys, uint32_t state) { \
+    CIPHER_UNROLL \
+    for (int r = 0; r < R; ++r) { \
+        state = feistel_SP_net32_round_encdec(state, roundkeys[r]); \
+    } \
+    return feistel_SP_net32_tau(state); \
+} \
+static uint32_t feistel_SP_net32_dec_rounds_r##R(const uint16_t *roundkeys, uint32_t state) { \
+    CIPHER_UNROLL \
+    for (int r = R-1; r >= 0; --r) { \
+        state = feistel_SP_net32_round_encdec(state, roundkeys[r]); \
+    } \
+    return feistel_SP_net32_tau(state); \
+} \
+uint32_t feistel_SP_net32_enc_r##R(uint32_t block, uint32_t masterkey) { \
+    uint16_t roundkeys[R]; \
+    feistel_SP_net32_generate_round_keys((uint16_t)masterkey, roundkeys, R); \
+    return feistel_SP_net32_enc_rounds_r##R(roundkeys, block); \
+} \
+uint32_t feistel_SP_net32_dec_r##R(uint32_t block, uint32_t masterkey) { \
+    uint16_t roundkeys[R]; \
+    feistel_SP_net32_generate_round_keys((uint16_t)masterkey, roundkeys, R); \
+    return feistel_SP_net32_dec_rounds_r##R(roundkeys, block); \
+}
+FEISTEL_SP_NET32_FIXED_ROUNDS(FEISTEL_SP_NET32_DEFINE_FIXED)
+
+#define FEISTEL_SP_NET32_ENC_CASE(R)       case R: return feistel_SP_net32_enc_r##R(block, masterkey);
+#define FEISTEL_SP_NET32_DEC_CASE(R)       case R: return feistel_SP_net32_dec_r##R(block, masterkey);
+#define FEISTEL_SP_NET32_ENC_BLOCK_CASE(R) case R: return feistel_SP_net32_enc_rounds_r##R(ctx->roundkeys, block);
+#define FEISTEL_SP_NET32_DEC_BLOCK_CASE(R) case R: return feistel_SP_net32_dec_rounds_r##R(ctx->roundkeys, block);
+
 uint32_t feistel_SP_net32_enc(uint32_t block, uint32_t masterkey, uint32_t rounds) {
+    switch (rounds) {
+    FEISTEL_SP_NET32_FIXED_ROUNDS(FEISTEL_SP_NET32_ENC_CASE)
+    default: break;
+    }
+
     uint16_t *roundkeys = (uint16_t*)malloc(rounds * sizeof(uint16_t));
     feistel_SP_net32_generate_round_keys((uint16_t)masterkey, roundkeys, rounds);
 
@@ -99,6 +187,11 @@ uint32_t feistel_SP_net32_enc(uint32_t block, uint32_t masterkey, uint32_t round
 // encryption differs from decryption only in the order of the round keys
 
 uint32_t feistel_SP_net32_dec(uint32_t block, uint32_t masterkey, uint32_t rounds) {
+    switch (rounds) {
+    FEISTEL_SP_NET32_FIXED_ROUNDS(FEISTEL_SP_NET32_DEC_CASE)
+    default: break;
+    }
+
     uint16_t *roundkeys = (uint16_t*)malloc(rounds * sizeof(uint16_t));
     feistel_SP_net32_generate_round_keys((uint16_t)masterkey, roundkeys, rounds);
 
@@ -116,6 +209,190 @@ uint32_t feistel_SP_net32_dec(uint32_t block, uint32_t masterkey, uint32_t round
     return state;
 }
 
+void feistel_SP_net32_init(feistel_SP_net32_ctx_t *ctx, uint32_t masterkey, uint32_t rounds) {
+    if (rounds > FEISTEL_SP_NET32_MAX_ROUNDS) {
+        fprintf(stderr, "feistel spnet32 supports at most %d rounds\n", FEISTEL_SP_NET32_MAX_ROUNDS);
+        exit(1);
+    }
+    ctx->rounds = rounds;
+    // same key truncation as feistel_SP_net32_enc/dec
+    feistel_SP_net32_generate_round_keys((uint16_t)masterkey, ctx->roundkeys, rounds);
+}
+
+static void feistel_SP_net32_expand_keys(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+
+void feistel_SP_net32_init_batch(feistel_SP_net32_ctx_t *ctxs, const uint32_t *masterkeys, size_t count, uint32_t rounds) {
+    // an array of uint32_t keys is the 4-byte host-order keys of the descriptor
+    feistel_SP_net32_expand_keys(ctxs, (const uint8_t *)masterkeys, count, rounds);
+}
+
+uint32_t feistel_SP_net32_enc_block(const feistel_SP_net32_ctx_t *ctx, uint32_t block) {
+    switch (ctx->rounds) {
+    FEISTEL_SP_NET32_FIXED_ROUNDS(FEISTEL_SP_NET32_ENC_BLOCK_CASE)
+    default: break;
+    }
+    uint32_t state = block;
+    for (uint32_t r = 0; r < ctx->rounds; ++r) {
+        state = feistel_SP_net32_round_encdec(state, ctx->roundkeys[r]);
+    }
+    return feistel_SP_net32_tau(state);
+}
+
+uint32_t feistel_SP_net32_dec_block(const feistel_SP_net32_ctx_t *ctx, uint32_t block) {
+    switch (ctx->rounds) {
+    FEISTEL_SP_NET32_FIXED_ROUNDS(FEISTEL_SP_NET32_DEC_BLOCK_CASE)
+    default: break;
+    }
+    uint32_t state = block;
+    for (int r = ctx->rounds-1; r >= 0; --r) {
+        state = feistel_SP_net32_round_encdec(state, ctx->roundkeys[r]);
+    }
+    return feistel_SP_net32_tau(state);
+}
+
+// descriptor glue: blocks and keys are 4 bytes in host order
+
+static void feistel_SP_net32_cipher_setkey(void *ctx, const uint8_t *key, uint32_t rounds) {
+    uint32_t masterkey;
+    memcpy(&masterkey, key, sizeof(masterkey));
+    feistel_SP_net32_init((feistel_SP_net32_ctx_t *)ctx, masterkey, rounds);
+}
+
+static void feistel_SP_net32_cipher_setkey_batch(void *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    feistel_SP_net32_expand_keys((feistel_SP_net32_ctx_t *)ctxs, keys, count, rounds);
+}
+
+// batch key schedules: the same scheme as SP_net32_expand_keys_* (spnet.h),
+// with the round keys truncated to 16 bits
+static void feistel_SP_net32_expand_keys_scalar(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t masterkey;
+        memcpy(&masterkey, keys + k * 4, sizeof(masterkey));
+        ctxs[k].rounds = rounds;
+        // same key truncation as feistel_SP_net32_enc/dec
+        feistel_SP_net32_generate_round_keys((uint16_t)masterkey, ctxs[k].roundkeys, rounds);
+    }
+}
+
+#if DISPATCH_X86
+
+// 16 rounds per step as two 8-lane halves packed to 16 bits; a partial last step goes through a buffer
+DISPATCH_TARGET("avx2")
+static void feistel_SP_net32_expand_keys_avx2(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    __m256i right[FEISTEL_SP_NET32_MAX_ROUNDS / 8], left[FEISTEL_SP_NET32_MAX_ROUNDS / 8];
+    __m256i constant[FEISTEL_SP_NET32_MAX_ROUNDS / 8];
+    __m256i lane   = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i low16  = _mm256_set1_epi32(0xFFFF);
+    uint32_t steps = (rounds + 15) / 16;
+    for (uint32_t v = 0; v < 2 * steps; ++v) {
+        __m256i r   = _mm256_add_epi32(_mm256_set1_epi32((int)(8 * v)), lane);
+        right[v]    = _mm256_and_si256(r, _mm256_set1_epi32(31));
+        left[v]     = _mm256_sub_epi32(_mm256_set1_epi32(32), right[v]); // sllv by 32 gives 0
+        constant[v] = _mm256_mullo_epi32(r, _mm256_set1_epi32((int)0x9E3779B9));
+    }
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t masterkey;
+        memcpy(&masterkey, keys + k * 4, sizeof(masterkey));
+        __m256i key    = _mm256_set1_epi32((uint16_t)masterkey);
+        ctxs[k].rounds = rounds;
+        for (uint32_t i = 0; i < steps; ++i) {
+            __m256i lo = _mm256_or_si256(_mm256_srlv_epi32(key, right[2 * i]), _mm256_sllv_epi32(key, left[2 * i]));
+            __m256i hi = _mm256_or_si256(_mm256_srlv_epi32(key, right[2 * i + 1]), _mm256_sllv_epi32(key, left[2 * i + 1]));
+            lo = _mm256_and_si256(_mm256_xor_si256(lo, constant[2 * i]), low16);
+            hi = _mm256_and_si256(_mm256_xor_si256(hi, constant[2 * i + 1]), low16);
+            // packus works per 128-bit half: restore the round order with a qword permute
+            __m256i rk = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+            if (rounds - 16 * i >= 16) {
+                _mm256_storeu_si256((__m256i *)(ctxs[k].roundkeys + 16 * i), rk);
+            } else {
+                uint16_t buf[16];
+                _mm256_storeu_si256((__m256i *)buf, rk);
+                memcpy(ctxs[k].roundkeys + 16 * i, buf, (rounds - 16 * i) * sizeof(uint16_t));
+            }
+        }
+    }
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static void feistel_SP_net32_expand_keys_avx512(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    __m512i round[FEISTEL_SP_NET32_MAX_ROUNDS / 16], constant[FEISTEL_SP_NET32_MAX_ROUNDS / 16];
+    __mmask16 mask[FEISTEL_SP_NET32_MAX_ROUNDS / 16];
+    uint32_t vectors = (rounds + 15) / 16;
+    for (uint32_t v = 0; v < vectors; ++v) {
+        uint32_t left = rounds - 16 * v;
+        round[v]      = _mm512_add_epi32(_mm512_set1_epi32((int)(16 * v)), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        constant[v]   = _mm512_mullo_epi32(round[v], _mm512_set1_epi32((int)0x9E3779B9));
+        mask[v]       = left < 16 ? (__mmask16)((1u << left) - 1) : (__mmask16)0xFFFF;
+    }
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t masterkey;
+        memcpy(&masterkey, keys + k * 4, sizeof(masterkey));
+        __m512i key    = _mm512_set1_epi32((uint16_t)masterkey);
+        ctxs[k].rounds = rounds;
+        for (uint32_t v = 0; v < vectors; ++v) {
+            __m512i rk = _mm512_xor_si512(_mm512_rorv_epi32(key, round[v]), constant[v]);
+            _mm512_mask_cvtepi32_storeu_epi16(ctxs[k].roundkeys + 16 * v, mask[v], rk);
+        }
+    }
+}
+
+#endif
+
+typedef void (*feistel_SP_net32_expand_keys_kernel_t)(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+
+static void feistel_SP_net32_expand_keys_resolve(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+static feistel_SP_net32_expand_keys_kernel_t feistel_SP_net32_expand_keys_kernel = feistel_SP_net32_expand_keys_resolve;
+
+// first call picks the kernel for this cpu and replaces itself
+static void feistel_SP_net32_expand_keys_resolve(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    dispatch_level_t level                       = dispatch_level();
+    dispatch_level_t chosen                      = DISPATCH_SCALAR;
+    feistel_SP_net32_expand_keys_kernel_t kernel = feistel_SP_net32_expand_keys_scalar;
+#if DISPATCH_X86
+    if (level >= DISPATCH_AVX512)    { kernel = feistel_SP_net32_expand_keys_avx512; chosen = DISPATCH_AVX512; }
+    else if (level >= DISPATCH_AVX2) { kernel = feistel_SP_net32_expand_keys_avx2;   chosen = DISPATCH_AVX2;   }
+#else
+    (void)level;
+#endif
+    dispatch_note("feistel key schedule", chosen);
+    DISPATCH_STORE(feistel_SP_net32_expand_keys_kernel, kernel);
+    kernel(ctxs, keys, count, rounds);
+}
+
+static void feistel_SP_net32_expand_keys(feistel_SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    if (rounds > FEISTEL_SP_NET32_MAX_ROUNDS) {
+        fprintf(stderr, "feistel spnet32 supports at most %d rounds\n", FEISTEL_SP_NET32_MAX_ROUNDS);
+        exit(1);
+    }
+    DISPATCH_LOAD(feistel_SP_net32_expand_keys_kernel)(ctxs, keys, count, rounds);
+}
+
+static void feistel_SP_net32_cipher_enc(const void *ctx, uint8_t *out, const uint8_t *in) {
+    uint32_t block;
+    memcpy(&block, in, sizeof(block));
+    block = feistel_SP_net32_enc_block((const feistel_SP_net32_ctx_t *)ctx, block);
+    memcpy(out, &block, sizeof(block));
+}
+
+static void feistel_SP_net32_cipher_dec(const void *ctx, uint8_t *out, const uint8_t *in) {
+    uint32_t block;
+    memcpy(&block, in, sizeof(block));
+    block = feistel_SP_net32_dec_block((const feistel_SP_net32_ctx_t *)ctx, block);
+    memcpy(out, &block, sizeof(block));
+}
+
+const cipher_desc_t feistel_SP_net32_cipher = {
+    .name           = "feistel_spnet32",
+    .blocksize      = 4,
+    .keysize        = 4,
+    .ctxsize        = sizeof(feistel_SP_net32_ctx_t),
+    .default_rounds = 5,
+    .setkey         = feistel_SP_net32_cipher_setkey,
+    .setkey_batch   = feistel_SP_net32_cipher_setkey_batch,
+    .enc            = feistel_SP_net32_cipher_enc,
+    .dec            = feistel_SP_net32_cipher_dec,
+};
+
 #endif
 
 #endif
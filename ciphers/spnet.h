@@ -1,17 +1,58 @@
 #ifndef SPNET_H
 #define SPNET_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "../cipher.h"
+
+#define SP_NET32_MAX_ROUNDS 64
+
+// expanded key, filled once by SP_net32_init and reused for every block
+typedef struct {
+    uint32_t rounds;
+    uint32_t roundkeys[SP_NET32_MAX_ROUNDS];
+} SP_net32_ctx_t;
+
+// runtime rounds; dispatches to the fixed-round versions below when one exists
 uint32_t SP_net32_enc(uint32_t block, uint32_t masterkey, uint32_t rounds);
 uint32_t SP_net32_dec(uint32_t block, uint32_t masterkey, uint32_t rounds);
 
+// round counts with a fully unrolled specialization: SP_net32_enc_r5, SP_net32_dec_r5, ...
+#define SP_NET32_FIXED_ROUNDS(X) X(4) X(5) X(8) X(16)
+
+#define SP_NET32_DECLARE_FIXED(R) \
+uint32_t SP_net32_enc_r##R(uint32_t block, uint32_t masterkey); \
+uint32_t SP_net32_dec_r##R(uint32_t block, uint32_t masterkey);
+SP_NET32_FIXED_ROUNDS(SP_NET32_DECLARE_FIXED)
+
+void SP_net32_init(SP_net32_ctx_t *ctx, uint32_t masterkey, uint32_t rounds);
+// expands count keys at once, for data where every record has its own key
+void SP_net32_init_batch(SP_net32_ctx_t *ctxs, const uint32_t *masterkeys, size_t count, uint32_t rounds);
+uint32_t SP_net32_enc_block(const SP_net32_ctx_t *ctx, uint32_t block);
+uint32_t SP_net32_dec_block(const SP_net32_ctx_t *ctx, uint32_t block);
+// the 4-bit S-box of the round function (for table analysis)
+uint32_t SP_net32_sbox(uint32_t nibble);
+
+// descriptor for the generic mode layer, name "spnet32"
+extern const cipher_desc_t SP_net32_cipher;
+
 #ifdef SPNET_IMPL
 
+// descriptor helpers and the dispatch of the batch kernels
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef CIPHER_IMPL
+#define CIPHER_IMPL
+#endif
+#include "../cipher.h"
+#endif
+
 // example: 00110100 -> [cyceshift8, shiftval=5] -> 00000001 | 1010000 -> 101001
 static uint32_t SP_net32_right_cycleshift32(uint32_t num, uint32_t shiftval) {
-    return (num >> (shiftval % 32)) | (num << (32 - (shiftval % 32)));
+    // (32 - shift) % 32: a shift by 0 must not become x << 32
+    return (num >> (shiftval % 32)) | (num << ((32 - shiftval % 32) % 32));
 }
 
 // -> 9 -> 0
@@ -54,6 +95,10 @@ static void SP_net32_generate_round_keys(uint32_t masterkey, uint32_t *roundkeys
 }
 
 // substitution using table
+uint32_t SP_net32_sbox(uint32_t nibble) {
+    return SP_net32_S_block_straight[nibble & 0xF];
+}
+
 static uint32_t SP_net32_do_S_block32(uint32_t bytes, const uint32_t *S_block) {
     uint32_t res = 0;
     for (int i = 0; i < 8; ++i) {
@@ -89,7 +134,46 @@ static uint32_t SP_net32_round_dec(uint32_t block, uint32_t roundkey) {
     return res;
 }
 
+/* Fixed-round specializations: round keys live in an R-sized array on the stack
+and the round loops have a constant trip count, so they are fully unrolled */
+#define SP_NET32_DEFINE_FIXED(R) \
+static uint32_t SP_net32_enc_rounds_r##R(const uint32_t *roundkeys, uint32_t state) { \
+    CIPHER_UNROLL \
+    for (int r = 0; r < R; ++r) { \
+        state = SP_net32_round_enc(state, roundkeys[r]); \
+    } \
+    return state; \
+} \
+static uint32_t SP_net32_dec_rounds_r##R(const uint32_t *roundkeys, uint32_t state) { \
+    CIPHER_UNROLL \
+    for (int r = R-1; r >= 0; --r) { \
+        state = SP_net32_round_dec(state, roundkeys[r]); \
+    } \
+    return state; \
+} \
+uint32_t SP_net32_enc_r##R(uint32_t block, uint32_t masterkey) { \
+    uint32_t roundkeys[R]; \
+    SP_net32_generate_round_keys(masterkey, roundkeys, R); \
+    return SP_net32_enc_rounds_r##R(roundkeys, block); \
+} \
+uint32_t SP_net32_dec_r##R(uint32_t block, uint32_t masterkey) { \
+    uint32_t roundkeys[R]; \
+    SP_net32_generate_round_keys(masterkey, roundkeys, R); \
+    return SP_net32_dec_rounds_r##R(roundkeys, block); \
+}
+SP_NET32_FIXED_ROUNDS(SP_NET32_DEFINE_FIXED)
+
+#define SP_NET32_ENC_CASE(R)       case R: return SP_net32_enc_r##R(block, masterkey);
+#define SP_NET32_DEC_CASE(R)       case R: return SP_net32_dec_r##R(block, masterkey);
+#define SP_NET32_ENC_BLOCK_CASE(R) case R: return SP_net32_enc_rounds_r##R(ctx->roundkeys, block);
+#define SP_NET32_DEC_BLOCK_CASE(R) case R: return SP_net32_dec_rounds_r##R(ctx->roundkeys, block);
+
 uint32_t SP_net32_enc(uint32_t block, uint32_t masterkey, uint32_t rounds) {
+    switch (rounds) {
+    SP_NET32_FIXED_ROUNDS(SP_NET32_ENC_CASE)
+    default: break;
+    }
+
     // generate round keys
     uint32_t *roundkeys = (uint32_t *)malloc(rounds*sizeof(uint32_t));
     SP_net32_generate_round_keys(masterkey, roundkeys, rounds);
@@ -105,6 +189,11 @@ uint32_t SP_net32_enc(uint32_t block, uint32_t masterkey, uint32_t rounds) {
 }
 
 uint32_t SP_net32_dec(uint32_t block, uint32_t masterkey, uint32_t rounds) {
+    switch (rounds) {
+    SP_NET32_FIXED_ROUNDS(SP_NET32_DEC_CASE)
+    default: break;
+    }
+
     // generate round keys
     uint32_t *roundkeys = (uint32_t *)malloc(rounds*sizeof(uint32_t));
     SP_net32_generate_round_keys(masterkey, roundkeys, rounds);
@@ -120,6 +209,398 @@ uint32_t SP_net32_dec(uint32_t block, uint32_t masterkey, uint32_t rounds) {
     return state;
 }
 
+void SP_net32_init(SP_net32_ctx_t *ctx, uint32_t masterkey, uint32_t rounds) {
+    if (rounds > SP_NET32_MAX_ROUNDS) {
+        fprintf(stderr, "spnet32 supports at most %d rounds\n", SP_NET32_MAX_ROUNDS);
+        exit(1);
+    }
+    ctx->rounds = rounds;
+    SP_net32_generate_round_keys(masterkey, ctx->roundkeys, rounds);
+}
+
+static void SP_net32_expand_keys(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+
+void SP_net32_init_batch(SP_net32_ctx_t *ctxs, const uint32_t *masterkeys, size_t count, uint32_t rounds) {
+    // an array of uint32_t keys is the 4-byte host-order keys of the descriptor
+    SP_net32_expand_keys(ctxs, (const uint8_t *)masterkeys, count, rounds);
+}
+
+uint32_t SP_net32_enc_block(const SP_net32_ctx_t *ctx, uint32_t block) {
+    switch (ctx->rounds) {
+    SP_NET32_FIXED_ROUNDS(SP_NET32_ENC_BLOCK_CASE)
+    default: break;
+    }
+    uint32_t state = block;
+    for (uint32_t r = 0; r < ctx->rounds; ++r) {
+        state = SP_net32_round_enc(state, ctx->roundkeys[r]);
+    }
+    return state;
+}
+
+uint32_t SP_net32_dec_block(const SP_net32_ctx_t *ctx, uint32_t block) {
+    switch (ctx->rounds) {
+    SP_NET32_FIXED_ROUNDS(SP_NET32_DEC_BLOCK_CASE)
+    default: break;
+    }
+    uint32_t state = block;
+    for (int r = ctx->rounds-1; r >= 0; --r) {
+        state = SP_net32_round_dec(state, ctx->roundkeys[r]);
+    }
+    return state;
+}
+
+// descriptor glue: blocks and keys are 4 bytes in host order
+
+static void SP_net32_cipher_setkey(void *ctx, const uint8_t *key, uint32_t rounds) {
+    uint32_t masterkey;
+    memcpy(&masterkey, key, sizeof(masterkey));
+    SP_net32_init((SP_net32_ctx_t *)ctx, masterkey, rounds);
+}
+
+static void SP_net32_cipher_setkey_batch(void *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    SP_net32_expand_keys((SP_net32_ctx_t *)ctxs, keys, count, rounds);
+}
+
+static void SP_net32_cipher_enc(const void *ctx, uint8_t *out, const uint8_t *in) {
+    uint32_t block;
+    memcpy(&block, in, sizeof(block));
+    block = SP_net32_enc_block((const SP_net32_ctx_t *)ctx, block);
+    memcpy(out, &block, sizeof(block));
+}
+
+static void SP_net32_cipher_dec(const void *ctx, uint8_t *out, const uint8_t *in) {
+    uint32_t block;
+    memcpy(&block, in, sizeof(block));
+    block = SP_net32_dec_block((const SP_net32_ctx_t *)ctx, block);
+    memcpy(out, &block, sizeof(block));
+}
+
+static void SP_net32_enc_batch_scalar(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    for (size_t i = 0; i < blockscount; ++i) {
+        SP_net32_cipher_enc(ctx, out + i * 4, in + i * 4);
+    }
+}
+
+static void SP_net32_dec_batch_scalar(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    for (size_t i = 0; i < blockscount; ++i) {
+        SP_net32_cipher_dec(ctx, out + i * 4, in + i * 4);
+    }
+}
+
+static void SP_net32_expand_keys_scalar(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t masterkey;
+        memcpy(&masterkey, keys + k * 4, sizeof(masterkey));
+        ctxs[k].rounds = rounds;
+        SP_net32_generate_round_keys(masterkey, ctxs[k].roundkeys, rounds);
+    }
+}
+
+#if DISPATCH_X86
+
+#include <immintrin.h>
+
+/* simd kernels: one block per 32-bit lane (8 with avx2, 16 with avx512).
+The S-block is a 16-entry nibble table, i.e. exactly one byte shuffle per nibble half.
+The P-block is done as groups of bits that move by the same distance */
+
+typedef struct {
+    uint32_t count;
+    uint32_t mask[63];
+    int      shift[63];
+} SP_net32_P_groups_t;
+
+static void SP_net32_P_groups(SP_net32_P_groups_t *groups, const uint32_t *P_block) {
+    uint32_t masks[63] = {0};
+    for (int i = 0; i < 32; ++i) {
+        masks[(int)P_block[i] - i + 31] |= (uint32_t)1 << i;
+    }
+    groups->count = 0;
+    for (int shift = -31; shift <= 31; ++shift) {
+        if (!masks[shift + 31]) continue;
+        groups->mask[groups->count]  = masks[shift + 31];
+        groups->shift[groups->count] = shift;
+        ++groups->count;
+    }
+}
+
+static void SP_net32_S_table(uint8_t *table, const uint32_t *S_block, int copies) {
+    for (int i = 0; i < 16 * copies; ++i) {
+        table[i] = S_block[i % 16];
+    }
+}
+
+DISPATCH_TARGET("avx2")
+static __m256i SP_net32_do_S_block_avx2(__m256i x, __m256i table) {
+    __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo     = _mm256_shuffle_epi8(table, _mm256_and_si256(x, nibble));
+    __m256i hi     = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+    return _mm256_or_si256(lo, _mm256_slli_epi16(hi, 4));
+}
+
+DISPATCH_TARGET("avx2")
+static __m256i SP_net32_do_P_block_avx2(__m256i x, const SP_net32_P_groups_t *groups) {
+    __m256i res = _mm256_setzero_si256();
+    for (uint32_t g = 0; g < groups->count; ++g) {
+        __m256i bits  = _mm256_and_si256(x, _mm256_set1_epi32(groups->mask[g]));
+        __m128i shift = _mm_cvtsi32_si128(groups->shift[g] >= 0 ? groups->shift[g] : -groups->shift[g]);
+        bits          = groups->shift[g] >= 0 ? _mm256_sll_epi32(bits, shift) : _mm256_srl_epi32(bits, shift);
+        res           = _mm256_or_si256(res, bits);
+    }
+    return res;
+}
+
+DISPATCH_TARGET("avx2")
+static void SP_net32_enc_batch_avx2(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    uint8_t table[32];
+    SP_net32_P_groups_t groups;
+    SP_net32_S_table(table, SP_net32_S_block_straight, 2);
+    SP_net32_P_groups(&groups, SP_net32_P_block_straight);
+    __m256i S = _mm256_loadu_si256((const __m256i *)table);
+
+    // the last partial vector runs with masked loads and stores, so few blocks still take the simd path
+    for (size_t i = 0; i < blockscount; i += 8) {
+        size_t left   = blockscount - i;
+        __m256i mask  = _mm256_cmpgt_epi32(_mm256_set1_epi32(left < 8 ? (int)left : 8), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i state = _mm256_maskload_epi32((const int *)(in + i * 4), mask);
+        for (uint32_t r = 0; r < ctx->rounds; ++r) {
+            state = _mm256_xor_si256(state, _mm256_set1_epi32(ctx->roundkeys[r]));
+            state = SP_net32_do_S_block_avx2(state, S);
+            state = SP_net32_do_P_block_avx2(state, &groups);
+        }
+        _mm256_maskstore_epi32((int *)(out + i * 4), mask, state);
+    }
+}
+
+DISPATCH_TARGET("avx2")
+static void SP_net32_dec_batch_avx2(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    uint8_t table[32];
+    SP_net32_P_groups_t groups;
+    SP_net32_S_table(table, SP_net32_S_block_reverse, 2);
+    SP_net32_P_groups(&groups, SP_net32_P_block_reverse);
+    __m256i S = _mm256_loadu_si256((const __m256i *)table);
+
+    // the last partial vector runs with masked loads and stores, so few blocks still take the simd path
+    for (size_t i = 0; i < blockscount; i += 8) {
+        size_t left   = blockscount - i;
+        __m256i mask  = _mm256_cmpgt_epi32(_mm256_set1_epi32(left < 8 ? (int)left : 8), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i state = _mm256_maskload_epi32((const int *)(in + i * 4), mask);
+        for (int r = ctx->rounds-1; r >= 0; --r) {
+            state = SP_net32_do_P_block_avx2(state, &groups);
+            state = SP_net32_do_S_block_avx2(state, S);
+            state = _mm256_xor_si256(state, _mm256_set1_epi32(ctx->roundkeys[r]));
+        }
+        _mm256_maskstore_epi32((int *)(out + i * 4), mask, state);
+    }
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static __m512i SP_net32_do_S_block_avx512(__m512i x, __m512i table) {
+    __m512i nibble = _mm512_set1_epi8(0x0F);
+    __m512i lo     = _mm512_shuffle_epi8(table, _mm512_and_si512(x, nibble));
+    __m512i hi     = _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(x, 4), nibble));
+    return _mm512_or_si512(lo, _mm512_slli_epi16(hi, 4));
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static __m512i SP_net32_do_P_block_avx512(__m512i x, const SP_net32_P_groups_t *groups) {
+    __m512i res = _mm512_setzero_si512();
+    for (uint32_t g = 0; g < groups->count; ++g) {
+        __m512i bits  = _mm512_and_si512(x, _mm512_set1_epi32(groups->mask[g]));
+        __m128i shift = _mm_cvtsi32_si128(groups->shift[g] >= 0 ? groups->shift[g] : -groups->shift[g]);
+        bits          = groups->shift[g] >= 0 ? _mm512_sll_epi32(bits, shift) : _mm512_srl_epi32(bits, shift);
+        res           = _mm512_or_si512(res, bits);
+    }
+    return res;
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static void SP_net32_enc_batch_avx512(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    uint8_t table[64];
+    SP_net32_P_groups_t groups;
+    SP_net32_S_table(table, SP_net32_S_block_straight, 4);
+    SP_net32_P_groups(&groups, SP_net32_P_block_straight);
+    __m512i S = _mm512_loadu_si512((const void *)table);
+
+    for (size_t i = 0; i < blockscount; i += 16) {
+        size_t left   = blockscount - i;
+        __mmask16 k   = left < 16 ? (__mmask16)((1u << left) - 1) : (__mmask16)0xFFFF;
+        __m512i state = _mm512_maskz_loadu_epi32(k, in + i * 4);
+        for (uint32_t r = 0; r < ctx->rounds; ++r) {
+            state = _mm512_xor_si512(state, _mm512_set1_epi32(ctx->roundkeys[r]));
+            state = SP_net32_do_S_block_avx512(state, S);
+            state = SP_net32_do_P_block_avx512(state, &groups);
+        }
+        _mm512_mask_storeu_epi32(out + i * 4, k, state);
+    }
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static void SP_net32_dec_batch_avx512(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    uint8_t table[64];
+    SP_net32_P_groups_t groups;
+    SP_net32_S_table(table, SP_net32_S_block_reverse, 4);
+    SP_net32_P_groups(&groups, SP_net32_P_block_reverse);
+    __m512i S = _mm512_loadu_si512((const void *)table);
+
+    for (size_t i = 0; i < blockscount; i += 16) {
+        size_t left   = blockscount - i;
+        __mmask16 k   = left < 16 ? (__mmask16)((1u << left) - 1) : (__mmask16)0xFFFF;
+        __m512i state = _mm512_maskz_loadu_epi32(k, in + i * 4);
+        for (int r = ctx->rounds-1; r >= 0; --r) {
+            state = SP_net32_do_P_block_avx512(state, &groups);
+            state = SP_net32_do_S_block_avx512(state, S);
+            state = _mm512_xor_si512(state, _mm512_set1_epi32(ctx->roundkeys[r]));
+        }
+        _mm512_mask_storeu_epi32(out + i * 4, k, state);
+    }
+}
+
+/* key schedules of a batch: roundkeys[r] = rotr(key, r) ^ r * 0x9E3779B9 is
+vectorized over the rounds of one key, the contiguous direction of a context
+(across keys the stores would be strided); the shift counts and constants are
+the same for every key and built once per call */
+
+DISPATCH_TARGET("avx2")
+static void SP_net32_expand_keys_avx2(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    __m256i right[SP_NET32_MAX_ROUNDS / 8], left[SP_NET32_MAX_ROUNDS / 8];
+    __m256i constant[SP_NET32_MAX_ROUNDS / 8], mask[SP_NET32_MAX_ROUNDS / 8];
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    uint32_t vectors = (rounds + 7) / 8;
+    for (uint32_t v = 0; v < vectors; ++v) {
+        __m256i r   = _mm256_add_epi32(_mm256_set1_epi32((int)(8 * v)), lane);
+        right[v]    = _mm256_and_si256(r, _mm256_set1_epi32(31));
+        // 32 - 0 = 32: sllv gives 0 for counts above 31, so round 0 is the key itself
+        left[v]     = _mm256_sub_epi32(_mm256_set1_epi32(32), right[v]);
+        constant[v] = _mm256_mullo_epi32(r, _mm256_set1_epi32((int)0x9E3779B9));
+        mask[v]     = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(rounds - 8 * v)), lane);
+    }
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t masterkey;
+        memcpy(&masterkey, keys + k * 4, sizeof(masterkey));
+        __m256i key    = _mm256_set1_epi32((int)masterkey);
+        ctxs[k].rounds = rounds;
+        for (uint32_t v = 0; v < vectors; ++v) {
+            __m256i rk = _mm256_or_si256(_mm256_srlv_epi32(key, right[v]), _mm256_sllv_epi32(key, left[v]));
+            _mm256_maskstore_epi32((int *)(ctxs[k].roundkeys + 8 * v), mask[v], _mm256_xor_si256(rk, constant[v]));
+        }
+    }
+}
+
+DISPATCH_TARGET("avx512f,avx512bw")
+static void SP_net32_expand_keys_avx512(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    __m512i round[SP_NET32_MAX_ROUNDS / 16], constant[SP_NET32_MAX_ROUNDS / 16];
+    __mmask16 mask[SP_NET32_MAX_ROUNDS / 16];
+    uint32_t vectors = (rounds + 15) / 16;
+    for (uint32_t v = 0; v < vectors; ++v) {
+        uint32_t left = rounds - 16 * v;
+        round[v]      = _mm512_add_epi32(_mm512_set1_epi32((int)(16 * v)), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        constant[v]   = _mm512_mullo_epi32(round[v], _mm512_set1_epi32((int)0x9E3779B9));
+        mask[v]       = left < 16 ? (__mmask16)((1u << left) - 1) : (__mmask16)0xFFFF;
+    }
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t masterkey;
+        memcpy(&masterkey, keys + k * 4, sizeof(masterkey));
+        __m512i key    = _mm512_set1_epi32((int)masterkey);
+        ctxs[k].rounds = rounds;
+        for (uint32_t v = 0; v < vectors; ++v) {
+            // vprord takes the count modulo 32
+            __m512i rk = _mm512_xor_si512(_mm512_rorv_epi32(key, round[v]), constant[v]);
+            _mm512_mask_storeu_epi32(ctxs[k].roundkeys + 16 * v, mask[v], rk);
+        }
+    }
+}
+
+#endif
+
+typedef void (*SP_net32_expand_keys_kernel_t)(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+
+static void SP_net32_expand_keys_resolve(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds);
+static SP_net32_expand_keys_kernel_t SP_net32_expand_keys_kernel = SP_net32_expand_keys_resolve;
+
+// first call picks the kernel for this cpu and replaces itself
+static void SP_net32_expand_keys_resolve(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    dispatch_level_t level               = dispatch_level();
+    dispatch_level_t chosen              = DISPATCH_SCALAR;
+    SP_net32_expand_keys_kernel_t kernel = SP_net32_expand_keys_scalar;
+#if DISPATCH_X86
+    if (level >= DISPATCH_AVX512)    { kernel = SP_net32_expand_keys_avx512; chosen = DISPATCH_AVX512; }
+    else if (level >= DISPATCH_AVX2) { kernel = SP_net32_expand_keys_avx2;   chosen = DISPATCH_AVX2;   }
+#else
+    (void)level;
+#endif
+    dispatch_note("SP_net32 key schedule", chosen);
+    DISPATCH_STORE(SP_net32_expand_keys_kernel, kernel);
+    kernel(ctxs, keys, count, rounds);
+}
+
+static void SP_net32_expand_keys(SP_net32_ctx_t *ctxs, const uint8_t *keys, size_t count, uint32_t rounds) {
+    if (rounds > SP_NET32_MAX_ROUNDS) {
+        fprintf(stderr, "spnet32 supports at most %d rounds\n", SP_NET32_MAX_ROUNDS);
+        exit(1);
+    }
+    DISPATCH_LOAD(SP_net32_expand_keys_kernel)(ctxs, keys, count, rounds);
+}
+
+typedef void (*SP_net32_batch_kernel_t)(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount);
+
+static void SP_net32_enc_batch_resolve(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount);
+static void SP_net32_dec_batch_resolve(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount);
+static SP_net32_batch_kernel_t SP_net32_enc_batch_kernel = SP_net32_enc_batch_resolve;
+static SP_net32_batch_kernel_t SP_net32_dec_batch_kernel = SP_net32_dec_batch_resolve;
+
+// there is no sse2 kernel (byte shuffles need ssse3), sse2 hosts run the scalar one
+static void SP_net32_pick_batch_kernels(void) {
+    dispatch_level_t level      = dispatch_level();
+    dispatch_level_t chosen     = DISPATCH_SCALAR;
+    SP_net32_batch_kernel_t enc = SP_net32_enc_batch_scalar;
+    SP_net32_batch_kernel_t dec = SP_net32_dec_batch_scalar;
+#if DISPATCH_X86
+    if (level >= DISPATCH_AVX512) {
+        enc = SP_net32_enc_batch_avx512; dec = SP_net32_dec_batch_avx512; chosen = DISPATCH_AVX512;
+    } else if (level >= DISPATCH_AVX2) {
+        enc = SP_net32_enc_batch_avx2;   dec = SP_net32_dec_batch_avx2;   chosen = DISPATCH_AVX2;
+    }
+#else
+    (void)level;
+#endif
+    dispatch_note("SP_net32 batch", chosen);
+    DISPATCH_STORE(SP_net32_enc_batch_kernel, enc);
+    DISPATCH_STORE(SP_net32_dec_batch_kernel, dec);
+}
+
+static void SP_net32_enc_batch_resolve(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    SP_net32_pick_batch_kernels();
+    DISPATCH_LOAD(SP_net32_enc_batch_kernel)(ctx, out, in, blockscount);
+}
+
+static void SP_net32_dec_batch_resolve(const SP_net32_ctx_t *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    SP_net32_pick_batch_kernels();
+    DISPATCH_LOAD(SP_net32_dec_batch_kernel)(ctx, out, in, blockscount);
+}
+
+static void SP_net32_cipher_enc_batch(const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    DISPATCH_LOAD(SP_net32_enc_batch_kernel)((const SP_net32_ctx_t *)ctx, out, in, blockscount);
+}
+
+static void SP_net32_cipher_dec_batch(const void *ctx, uint8_t *out, const uint8_t *in, size_t blockscount) {
+    DISPATCH_LOAD(SP_net32_dec_batch_kernel)((const SP_net32_ctx_t *)ctx, out, in, blockscount);
+}
+
+const cipher_desc_t SP_net32_cipher = {
+    .name           = "spnet32",
+    .blocksize      = 4,
+    .keysize        = 4,
+    .ctxsize        = sizeof(SP_net32_ctx_t),
+    .default_rounds = 5,
+    .setkey         = SP_net32_cipher_setkey,
+    .setkey_batch   = SP_net32_cipher_setkey_batch,
+    .enc            = SP_net32_cipher_enc,
+    .dec            = SP_net32_cipher_dec,
+    .enc_batch      = SP_net32_cipher_enc_batch,
+    .dec_batch      = SP_net32_cipher_dec_batch,
+};
+
 #endif
 
 #endif
@@ -0,0 +1,131 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <stdio.h>
+
+// DISPATCH_IMPL compiles the implementation; CIPHER_IMPL and ANALYSIS_IMPL define it too
+
+// instruction set levels a kernel can be written for, each one implies the previous
+typedef enum {
+    DISPATCH_SCALAR = 0,
+    DISPATCH_SSE2,
+    DISPATCH_AVX2,
+    DISPATCH_AVX512, // avx512f + avx512bw
+} dispatch_level_t;
+
+// the simd kernels are built with per-function target attributes,
+// so the rest of the code does not need -mavx2 and runs on any x86 host
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DISPATCH_X86 1
+#define DISPATCH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DISPATCH_X86 0
+#endif
+
+// environment variable to force a lower level, e.g. CRYPTO_CPU_LEVEL=scalar
+#define DISPATCH_ENV "CRYPTO_CPU_LEVEL"
+
+// best level of this cpu (detected on first call), lowered by DISPATCH_ENV if set
+dispatch_level_t dispatch_level(void);
+const char *dispatch_level_name(dispatch_level_t level);
+
+// dispatched functions resolve their kernel on first use and note the choice here
+void dispatch_note(const char *function, dispatch_level_t level);
+void dispatch_report(FILE *f);
+
+/* kernel pointers start at a resolver and are replaced by it on first call,
+possibly while other threads call through them: they are only read and
+written with these (every racing resolver stores the same kernel) */
+#if defined(__GNUC__) || defined(__clang__)
+#define DISPATCH_LOAD(ptr)         __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+#define DISPATCH_STORE(ptr, value) __atomic_store_n(&(ptr), (value), __ATOMIC_RELEASE)
+#else
+#define DISPATCH_LOAD(ptr)         (ptr)
+#define DISPATCH_STORE(ptr, value) ((ptr) = (value))
+#endif
+
+#endif
+
+// own guard: cipher.h includes this file again with DISPATCH_IMPL to get the implementation
+#if defined(DISPATCH_IMPL) && !defined(DISPATCH_IMPL_DONE)
+#define DISPATCH_IMPL_DONE
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define DISPATCH_MAX_NOTES 32
+
+static const char *dispatch_names[] = {"scalar", "sse2", "avx2", "avx512"};
+
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+static dispatch_level_t dispatch_detected;
+static dispatch_level_t dispatch_selected;
+
+static pthread_mutex_t dispatch_notes_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *dispatch_note_function[DISPATCH_MAX_NOTES];
+static dispatch_level_t dispatch_note_level[DISPATCH_MAX_NOTES];
+static int dispatch_notes = 0;
+
+static dispatch_level_t dispatch_detect(void) {
+#if DISPATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return DISPATCH_AVX512;
+    if (__builtin_cpu_supports("avx2")) return DISPATCH_AVX2;
+    if (__builtin_cpu_supports("sse2")) return DISPATCH_SSE2;
+#endif
+    return DISPATCH_SCALAR;
+}
+
+static void dispatch_resolve(void) {
+    dispatch_level_t level = dispatch_detect();
+    dispatch_detected      = level;
+
+    const char *forced = getenv(DISPATCH_ENV);
+    if (forced) {
+        int found = 0;
+        for (int i = 0; i <= DISPATCH_AVX512; ++i) {
+            if (strcmp(forced, dispatch_names[i])) continue;
+            found = 1;
+            if ((dispatch_level_t)i <= level) level = (dispatch_level_t)i;
+            else fprintf(stderr, "%s=%s is not supported by this cpu, using %s\n", DISPATCH_ENV, forced, dispatch_names[level]);
+        }
+        if (!found) fprintf(stderr, "%s=%s is unknown (scalar, sse2, avx2, avx512)\n", DISPATCH_ENV, forced);
+    }
+
+    dispatch_selected = level;
+}
+
+// resolved once, threads that call it concurrently wait for the first one
+dispatch_level_t dispatch_level(void) {
+    pthread_once(&dispatch_once, dispatch_resolve);
+    return dispatch_selected;
+}
+
+const char *dispatch_level_name(dispatch_level_t level) {
+    return dispatch_names[level];
+}
+
+void dispatch_note(const char *function, dispatch_level_t level) {
+    pthread_mutex_lock(&dispatch_notes_lock);
+    int i = 0;
+    while (i < dispatch_notes && strcmp(dispatch_note_function[i], function)) ++i;
+    if (i < DISPATCH_MAX_NOTES) {
+        dispatch_note_function[i] = function;
+        dispatch_note_level[i]    = level;
+        if (i == dispatch_notes) ++dispatch_notes;
+    }
+    pthread_mutex_unlock(&dispatch_notes_lock);
+}
+
+void dispatch_report(FILE *f) {
+    dispatch_level();
+    fprintf(f, "cpu level: %s (detected %s)\n", dispatch_names[dispatch_selected], dispatch_names[dispatch_detected]);
+    pthread_mutex_lock(&dispatch_notes_lock);
+    for (int i = 0; i < dispatch_notes; ++i) {
+        fprintf(f, "  %-24s %s\n", dispatch_note_function[i], dispatch_names[dispatch_note_level[i]]);
+    }
+    pthread_mutex_unlock(&dispatch_notes_lock);
+}
+
+#endif
@@ -3,9 +3,223 @@
 
 #include <stdint.h>
 
+#include "cipher.h"
+
+// MODES_IMPL compiles the implementation and cipher.h's; SECTOR_IMPL defines it too
+
 typedef uint32_t (*cipher32_func_t)(uint32_t block, uint32_t key, uint32_t rounds);
 typedef uint64_t (*cipher64_func_t)(uint64_t block, uint64_t key, uint32_t rounds);
 
+// number of streams advanced together by cbc_enc*_multi
+// (16 fills the widest batch kernel: 16 x 32-bit blocks in an avx-512 register)
+#define MODES_CBC_LANES 16
+
+// blocks handed to a batch function at once by the modes that can batch
+#define MODES_CHUNK_BLOCKS 64
+
+// keys expanded together by the *_keyed modes
+#define MODES_KEY_BATCH 64
+
+// one independent cbc message: its own buffers, length and iv
+typedef struct {
+    uint8_t *data_encrypted;
+    const uint8_t *data;
+    uint32_t blockscount;
+    const uint8_t *iv;
+} cbc_stream_t;
+
+// one record of the *_keyed modes, encrypted under its own key
+typedef struct {
+    uint8_t *out;
+    const uint8_t *in;
+    uint32_t blockscount;
+    const uint8_t *iv; // cbc only
+} mode_record_t;
+
+// operation of a generic mode call (keyed records and resumable jobs)
+typedef enum {
+    MODES_ECB_ENC,
+    MODES_ECB_DEC,
+    MODES_CBC_ENC,
+    MODES_CBC_DEC,
+    MODES_CFB_ENC,
+    MODES_CFB_DEC,
+} mode_op_t;
+
+// one mode call split into bounded steps (see mode_job_step): the job keeps
+// the cursor and the chaining block, so nothing else has to survive between steps
+typedef struct {
+    const cipher_desc_t *cipher;
+    const void *ctx;
+    mode_op_t op;
+    uint8_t *out;
+    const uint8_t *in;
+    uint32_t blockscount;
+    uint32_t done;                       // blocks finished so far
+    uint64_t block_ps;                   // measured picoseconds per block, 0 = not measured yet
+    uint8_t chain[CIPHER_MAX_BLOCKSIZE]; // iv, then the last ciphertext block
+} mode_job_t;
+
+typedef struct {
+    uint32_t *data_encrypted;
+    uint32_t *data;
+    uint32_t blockscount;
+    uint32_t iv;
+} cbc_stream32_t;
+
+typedef struct {
+    uint64_t *data_encrypted;
+    uint64_t *data;
+    uint32_t blockscount;
+    uint64_t iv;
+} cbc_stream64_t;
+
+// GENERIC VERSIONS DECLARATIONS
+// ctx is the expanded key filled by cipher->setkey, iv is cipher->blocksize bytes
+
+void ecb_enc(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount);
+
+void ecb_dec(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount);
+
+void cbc_enc(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount,
+const uint8_t *iv);
+
+void cbc_dec(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount,
+const uint8_t *iv);
+
+void cfb_enc(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount,
+const uint8_t *iv);
+
+void cfb_dec(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount,
+const uint8_t *iv);
+
+// encrypts many independent messages (same key) together: one block of each
+// of MODES_CBC_LANES streams per step, lanes are refilled as streams finish
+void cbc_enc_multi(
+const cipher_desc_t *cipher,
+const void *ctx,
+cbc_stream_t *streams,
+uint32_t streamscount);
+
+// per-record keys: record i uses keys + i * cipher->keysize, the key
+// schedules are expanded MODES_KEY_BATCH at a time with cipher_setkey_batch
+
+void ecb_enc_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount);
+
+void ecb_dec_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount);
+
+void cbc_enc_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount);
+
+void cbc_dec_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount);
+
+// resumable jobs, for a caller that must not block for the whole buffer (a
+// single-threaded event loop): iv is ignored for ecb, buffers must stay valid
+// until the job is done, out == in is allowed
+
+void mode_job_init(
+mode_job_t *job,
+const cipher_desc_t *cipher,
+const void *ctx,
+mode_op_t op,
+uint8_t *out,
+const uint8_t *in,
+uint32_t blockscount,
+const uint8_t *iv);
+
+/* processes at most max_blocks blocks and stops before max_ns nanoseconds
+have passed (0 = no limit); returns 1 when the job is finished, 0 if not.
+Chunks are sized from the time per block measured by the earlier steps of the
+job, the first step starts with a single block; every call does at least one
+block. A time limit needs clock_gettime(CLOCK_MONOTONIC) (POSIX), declared
+when the file that defines MODES_IMPL defines _POSIX_C_SOURCE 199309L or
+_GNU_SOURCE before any #include (plain -std=c99 does not): without it
+MODES_JOB_CLOCK is 0 and a call with max_ns != 0 returns -1 and does nothing */
+int mode_job_step(
+mode_job_t *job,
+uint32_t max_blocks,
+uint64_t max_ns);
+
+// encrypt-then-mac in one pass over the buffer: cbc encryption under enc_ctx
+// and a cbc-mac of (length, iv, ciphertext) under mac_ctx, which must hold a
+// different key; the ciphertext of every chunk is fed to the mac while it is
+// still in cache. tag is cipher->blocksize bytes
+
+// cbc_dec_verify flags
+#define MODES_VERIFY_FIRST 1 // check the whole tag before any plaintext is written (two passes)
+
+void cbc_enc_mac(
+const cipher_desc_t *cipher,
+const void *enc_ctx,
+const void *mac_ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount,
+const uint8_t *iv,
+uint8_t *tag);
+
+// returns 0 when the tag matches; otherwise -1 and, in the one-pass default,
+// the output is wiped (with out == in the ciphertext is lost too)
+int cbc_dec_verify(
+const cipher_desc_t *cipher,
+const void *enc_ctx,
+const void *mac_ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount,
+const uint8_t *iv,
+const uint8_t *tag,
+int flags);
+
 // 32-BIT VERSIONS DECLARATIONS
 
 void ecb_enc32(
@@ -60,6 +274,13 @@ uint32_t rounds,
 uint32_t iv,
 cipher32_func_t enc);
 
+void cbc_enc32_multi(
+cbc_stream32_t *streams,
+uint32_t streamscount,
+uint32_t masterkey,
+uint32_t rounds,
+cipher32_func_t enc);
+
 // 64-BIT VERSIONS DECLARATIONS
 
 void ecb_enc64(
@@ -114,7 +335,486 @@ uint32_t rounds,
 uint64_t iv,
 cipher64_func_t enc);
 
-#ifdef MODES_IMPL
+void cbc_enc64_multi(
+cbc_stream64_t *streams,
+uint32_t streamscount,
+uint64_t masterkey,
+uint32_t rounds,
+cipher64_func_t enc);
+
+#endif
+
+// own guard: sector.h includes this file again with MODES_IMPL
+#if defined(MODES_IMPL) && !defined(MODES_IMPL_DONE)
+#define MODES_IMPL_DONE
+
+// the modes run on cipher_xor and the batch helpers
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef CIPHER_IMPL
+#define CIPHER_IMPL
+#endif
+#include "cipher.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ==================== GENERIC IMPLEMENTATIONS ====================
+
+void ecb_enc(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount) {
+    cipher_enc_batch(cipher, ctx, data_encrypted, data, blockscount);
+}
+
+void ecb_dec(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount) {
+    cipher_dec_batch(cipher, ctx, data_decrypted, data_encrypted, blockscount);
+}
+
+void cbc_enc(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount,
+const uint8_t *iv) {
+    uint32_t bs = cipher->blocksize;
+    uint8_t input[CIPHER_MAX_BLOCKSIZE];
+    const uint8_t *prev = iv;
+    for (uint32_t i = 0; i < blockscount; ++i) {
+        cipher_xor(input, data + i * bs, prev, bs);
+        cipher->enc(ctx, data_encrypted + i * bs, input);
+        prev = data_encrypted + i * bs;
+    }
+}
+
+// every block is decrypted independently, so whole chunks go through dec_batch
+void cbc_dec(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount,
+const uint8_t *iv) {
+    uint32_t bs = cipher->blocksize;
+    uint8_t prev[CIPHER_MAX_BLOCKSIZE];
+    uint8_t buf[MODES_CHUNK_BLOCKS * CIPHER_MAX_BLOCKSIZE];
+    memcpy(prev, iv, bs);
+    for (uint32_t i = 0; i < blockscount; i += MODES_CHUNK_BLOCKS) {
+        uint32_t count      = blockscount - i < MODES_CHUNK_BLOCKS ? blockscount - i : MODES_CHUNK_BLOCKS;
+        const uint8_t *src  = data_encrypted + i * bs;
+        cipher_dec_batch(cipher, ctx, buf, src, count);
+        cipher_xor(buf, buf, prev, bs);
+        cipher_xor(buf + bs, buf + bs, src, (count - 1) * bs);
+        // keep the last ciphertext block before the output may overwrite it (in-place)
+        memcpy(prev, src + (count - 1) * bs, bs);
+        memcpy(data_decrypted + i * bs, buf, count * bs);
+    }
+}
+
+void cfb_enc(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount,
+const uint8_t *iv) {
+    uint32_t bs = cipher->blocksize;
+    uint8_t keystream[CIPHER_MAX_BLOCKSIZE];
+    const uint8_t *prev = iv;
+    for (uint32_t i = 0; i < blockscount; ++i) {
+        cipher->enc(ctx, keystream, prev);
+        cipher_xor(data_encrypted + i * bs, data + i * bs, keystream, bs);
+        prev = data_encrypted + i * bs;
+    }
+}
+
+// the keystream is the encryption of the previous ciphertext blocks, so it is batched
+void cfb_dec(
+const cipher_desc_t *cipher,
+const void *ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount,
+const uint8_t *iv) {
+    uint32_t bs = cipher->blocksize;
+    uint8_t prev[CIPHER_MAX_BLOCKSIZE];
+    uint8_t buf[MODES_CHUNK_BLOCKS * CIPHER_MAX_BLOCKSIZE];
+    memcpy(prev, iv, bs);
+    for (uint32_t i = 0; i < blockscount; i += MODES_CHUNK_BLOCKS) {
+        uint32_t count      = blockscount - i < MODES_CHUNK_BLOCKS ? blockscount - i : MODES_CHUNK_BLOCKS;
+        const uint8_t *src  = data_encrypted + i * bs;
+        memcpy(buf, prev, bs);
+        memcpy(buf + bs, src, (count - 1) * bs);
+        cipher_enc_batch(cipher, ctx, buf, buf, count);
+        memcpy(prev, src + (count - 1) * bs, bs);
+        cipher_xor(data_decrypted + i * bs, src, buf, count * bs);
+    }
+}
+
+void cbc_enc_multi(
+const cipher_desc_t *cipher,
+const void *ctx,
+cbc_stream_t *streams,
+uint32_t streamscount) {
+    uint32_t bs = cipher->blocksize;
+    cbc_stream_t *lane_stream[MODES_CBC_LANES];
+    uint32_t lane_pos[MODES_CBC_LANES];
+    const uint8_t *lane_prev[MODES_CBC_LANES];
+    uint8_t buf[MODES_CBC_LANES * CIPHER_MAX_BLOCKSIZE];
+    uint32_t lanes = 0;
+    uint32_t next  = 0;
+
+    for (;;) {
+        // refill free lanes with streams that still have blocks
+        while (lanes < MODES_CBC_LANES && next < streamscount) {
+            cbc_stream_t *s = &streams[next++];
+            if (s->blockscount == 0) continue;
+            lane_stream[lanes] = s;
+            lane_pos[lanes]    = 0;
+            lane_prev[lanes]   = s->iv;
+            ++lanes;
+        }
+        if (lanes == 0) break;
+
+        // one block of every lane, encrypted together in one batch call
+        for (uint32_t l = 0; l < lanes; ++l) {
+            cipher_xor(buf + l * bs, lane_stream[l]->data + lane_pos[l] * bs, lane_prev[l], bs);
+        }
+        cipher_enc_batch(cipher, ctx, buf, buf, lanes);
+        for (uint32_t l = 0; l < lanes; ++l) {
+            uint8_t *out = lane_stream[l]->data_encrypted + lane_pos[l]++ * bs;
+            memcpy(out, buf + l * bs, bs);
+            lane_prev[l] = out;
+        }
+
+        // drop finished lanes (last lane moves into the hole)
+        for (uint32_t l = 0; l < lanes;) {
+            if (lane_pos[l] < lane_stream[l]->blockscount) { ++l; continue; }
+            --lanes;
+            lane_stream[l] = lane_stream[lanes];
+            lane_pos[l]    = lane_pos[lanes];
+            lane_prev[l]   = lane_prev[lanes];
+        }
+    }
+}
+
+static void modes_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount,
+int mode) {
+    uint8_t *ctxs = (uint8_t *)malloc((size_t)MODES_KEY_BATCH * cipher->ctxsize);
+    for (uint32_t first = 0; first < recordscount; first += MODES_KEY_BATCH) {
+        uint32_t count = recordscount - first < MODES_KEY_BATCH ? recordscount - first : MODES_KEY_BATCH;
+        cipher_setkey_batch(cipher, ctxs, keys + (size_t)first * cipher->keysize, count, rounds);
+        for (uint32_t i = 0; i < count; ++i) {
+            const void *ctx  = ctxs + (size_t)i * cipher->ctxsize;
+            mode_record_t *r = &records[first + i];
+            switch (mode) {
+            case MODES_ECB_ENC: ecb_enc(cipher, ctx, r->out, r->in, r->blockscount);        break;
+            case MODES_ECB_DEC: ecb_dec(cipher, ctx, r->out, r->in, r->blockscount);        break;
+            case MODES_CBC_ENC: cbc_enc(cipher, ctx, r->out, r->in, r->blockscount, r->iv); break;
+            case MODES_CBC_DEC: cbc_dec(cipher, ctx, r->out, r->in, r->blockscount, r->iv); break;
+            }
+        }
+    }
+    free(ctxs);
+}
+
+void ecb_enc_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount) {
+    modes_keyed(cipher, rounds, keys, records, recordscount, MODES_ECB_ENC);
+}
+
+void ecb_dec_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount) {
+    modes_keyed(cipher, rounds, keys, records, recordscount, MODES_ECB_DEC);
+}
+
+void cbc_enc_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount) {
+    modes_keyed(cipher, rounds, keys, records, recordscount, MODES_CBC_ENC);
+}
+
+void cbc_dec_keyed(
+const cipher_desc_t *cipher,
+uint32_t rounds,
+const uint8_t *keys,
+mode_record_t *records,
+uint32_t recordscount) {
+    modes_keyed(cipher, rounds, keys, records, recordscount, MODES_CBC_DEC);
+}
+
+// ==================== RESUMABLE JOBS ====================
+
+// time budgets only where posix declares a monotonic clock (see mode_job_step)
+#ifdef CLOCK_MONOTONIC
+#define MODES_JOB_CLOCK 1
+#else
+#define MODES_JOB_CLOCK 0
+#endif
+
+static uint64_t modes_now_ns(void) {
+#if MODES_JOB_CLOCK
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+void mode_job_init(
+mode_job_t *job,
+const cipher_desc_t *cipher,
+const void *ctx,
+mode_op_t op,
+uint8_t *out,
+const uint8_t *in,
+uint32_t blockscount,
+const uint8_t *iv) {
+    job->cipher      = cipher;
+    job->ctx         = ctx;
+    job->op          = op;
+    job->out         = out;
+    job->in          = in;
+    job->blockscount = blockscount;
+    job->done        = 0;
+    job->block_ps    = 0;
+    memset(job->chain, 0, sizeof(job->chain));
+    if (iv && op != MODES_ECB_ENC && op != MODES_ECB_DEC) memcpy(job->chain, iv, cipher->blocksize);
+}
+
+int mode_job_step(
+mode_job_t *job,
+uint32_t max_blocks,
+uint64_t max_ns) {
+    if (max_ns && !MODES_JOB_CLOCK) return -1;
+    uint32_t bs    = job->cipher->blocksize;
+    uint64_t start = max_ns ? modes_now_ns() : 0, elapsed = 0;
+    uint32_t steps = 0;
+    int dec        = job->op == MODES_CBC_DEC || job->op == MODES_CFB_DEC;
+
+    while (job->done < job->blockscount) {
+        uint32_t count = job->blockscount - job->done;
+        if (count > MODES_CHUNK_BLOCKS) count = MODES_CHUNK_BLOCKS;
+        if (max_blocks) {
+            if (steps >= max_blocks) break;
+            if (count > max_blocks - steps) count = max_blocks - steps;
+        }
+        if (max_ns) {
+            // size the chunk from the measured rate (less 1/16 for timing noise), so a
+            // slow cipher does not overshoot by a whole chunk; a single block while
+            // there is no rate yet
+            if (elapsed >= max_ns) break;
+            uint64_t left = max_ns - elapsed;
+            uint64_t fit  = job->block_ps ? (left - left / 16) * 1000 / job->block_ps : 1;
+            if (fit == 0) {
+                if (steps) break;
+                fit = 1;
+            }
+            if (count > fit) count = (uint32_t)fit;
+        }
+
+        uint8_t *out      = job->out + (size_t)job->done * bs;
+        const uint8_t *in = job->in + (size_t)job->done * bs;
+        uint8_t next[CIPHER_MAX_BLOCKSIZE];
+        // decryption chains on the ciphertext, which an in-place call overwrites
+        if (dec) memcpy(next, in + (count - 1) * bs, bs);
+
+        switch (job->op) {
+        case MODES_ECB_ENC: ecb_enc(job->cipher, job->ctx, out, in, count);             break;
+        case MODES_ECB_DEC: ecb_dec(job->cipher, job->ctx, out, in, count);             break;
+        case MODES_CBC_ENC: cbc_enc(job->cipher, job->ctx, out, in, count, job->chain); break;
+        case MODES_CBC_DEC: cbc_dec(job->cipher, job->ctx, out, in, count, job->chain); break;
+        case MODES_CFB_ENC: cfb_enc(job->cipher, job->ctx, out, in, count, job->chain); break;
+        case MODES_CFB_DEC: cfb_dec(job->cipher, job->ctx, out, in, count, job->chain); break;
+        }
+        memcpy(job->chain, dec ? next : out + (count - 1) * bs, bs);
+
+        job->done += count;
+        steps     += count;
+        if (max_ns) {
+            // rate over this step, kept in the job for the first chunk of the next one
+            elapsed       = modes_now_ns() - start;
+            uint64_t ps   = elapsed * 1000 / steps;
+            job->block_ps = ps ? ps : 1;
+        }
+    }
+    return job->done == job->blockscount;
+}
+
+// ==================== ENCRYPT-THEN-MAC ====================
+
+// the length block first makes the cbc-mac safe for messages of different lengths
+static void modes_mac_start(
+const cipher_desc_t *cipher,
+const void *mac_ctx,
+uint8_t *state,
+uint32_t blockscount,
+const uint8_t *iv) {
+    uint32_t bs = cipher->blocksize;
+    memset(state, 0, bs);
+    for (uint32_t b = 0; b < 4 && b < bs; ++b) {
+        state[b] = (uint8_t)(blockscount >> (8 * b));
+    }
+    cipher->enc(mac_ctx, state, state);
+    cipher_xor(state, state, iv, bs);
+    cipher->enc(mac_ctx, state, state);
+}
+
+static void modes_mac_update(
+const cipher_desc_t *cipher,
+const void *mac_ctx,
+uint8_t *state,
+const uint8_t *data,
+uint32_t blockscount) {
+    uint32_t bs = cipher->blocksize;
+    for (uint32_t i = 0; i < blockscount; ++i) {
+        cipher_xor(state, state, data + i * bs, bs);
+        cipher->enc(mac_ctx, state, state);
+    }
+}
+
+void cbc_enc_mac(
+const cipher_desc_t *cipher,
+const void *enc_ctx,
+const void *mac_ctx,
+uint8_t *data_encrypted,
+const uint8_t *data,
+uint32_t blockscount,
+const uint8_t *iv,
+uint8_t *tag) {
+    uint32_t bs = cipher->blocksize;
+    uint8_t chain[CIPHER_MAX_BLOCKSIZE];
+    memcpy(chain, iv, bs);
+    modes_mac_start(cipher, mac_ctx, tag, blockscount, iv);
+    for (uint32_t i = 0; i < blockscount; i += MODES_CHUNK_BLOCKS) {
+        uint32_t count = blockscount - i < MODES_CHUNK_BLOCKS ? blockscount - i : MODES_CHUNK_BLOCKS;
+        uint8_t *out   = data_encrypted + (size_t)i * bs;
+        cbc_enc(cipher, enc_ctx, out, data + (size_t)i * bs, count, chain);
+        modes_mac_update(cipher, mac_ctx, tag, out, count);
+        memcpy(chain, out + (count - 1) * bs, bs);
+    }
+}
+
+int cbc_dec_verify(
+const cipher_desc_t *cipher,
+const void *enc_ctx,
+const void *mac_ctx,
+uint8_t *data_decrypted,
+const uint8_t *data_encrypted,
+uint32_t blockscount,
+const uint8_t *iv,
+const uint8_t *tag,
+int flags) {
+    uint32_t bs = cipher->blocksize;
+    uint8_t state[CIPHER_MAX_BLOCKSIZE];
+    uint8_t chain[CIPHER_MAX_BLOCKSIZE];
+    uint8_t diff = 0;
+    memcpy(chain, iv, bs);
+    modes_mac_start(cipher, mac_ctx, state, blockscount, iv);
+
+    if (flags & MODES_VERIFY_FIRST) {
+        modes_mac_update(cipher, mac_ctx, state, data_encrypted, blockscount);
+        for (uint32_t b = 0; b < bs; ++b) diff |= state[b] ^ tag[b];
+        if (diff) return -1;
+        cbc_dec(cipher, enc_ctx, data_decrypted, data_encrypted, blockscount, iv);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < blockscount; i += MODES_CHUNK_BLOCKS) {
+        uint32_t count     = blockscount - i < MODES_CHUNK_BLOCKS ? blockscount - i : MODES_CHUNK_BLOCKS;
+        const uint8_t *src = data_encrypted + (size_t)i * bs;
+        // mac the ciphertext chunk before an in-place decryption overwrites it
+        modes_mac_update(cipher, mac_ctx, state, src, count);
+        uint8_t next[CIPHER_MAX_BLOCKSIZE];
+        memcpy(next, src + (count - 1) * bs, bs);
+        cbc_dec(cipher, enc_ctx, data_decrypted + (size_t)i * bs, src, count, chain);
+        memcpy(chain, next, bs);
+    }
+    // compared without an early exit, so the time does not depend on where the tags differ
+    for (uint32_t b = 0; b < bs; ++b) diff |= state[b] ^ tag[b];
+    if (diff) {
+        memset(data_decrypted, 0, (size_t)blockscount * bs);
+        return -1;
+    }
+    return 0;
+}
+
+// ==================== 32/64-BIT WRAPPERS ====================
+// the fixed-width api is a cipher descriptor around a (block, key, rounds) function
+
+typedef struct {
+    cipher32_func_t func;
+    uint32_t masterkey;
+    uint32_t rounds;
+} modes_func32_ctx_t;
+
+typedef struct {
+    cipher64_func_t func;
+    uint64_t masterkey;
+    uint32_t rounds;
+} modes_func64_ctx_t;
+
+static void modes_func32_block(const void *ctx, uint8_t *out, const uint8_t *in) {
+    const modes_func32_ctx_t *c = (const modes_func32_ctx_t *)ctx;
+    uint32_t block;
+    memcpy(&block, in, sizeof(block));
+    block = c->func(block, c->masterkey, c->rounds);
+    memcpy(out, &block, sizeof(block));
+}
+
+static void modes_func64_block(const void *ctx, uint8_t *out, const uint8_t *in) {
+    const modes_func64_ctx_t *c = (const modes_func64_ctx_t *)ctx;
+    uint64_t block;
+    memcpy(&block, in, sizeof(block));
+    block = c->func(block, c->masterkey, c->rounds);
+    memcpy(out, &block, sizeof(block));
+}
+
+// enc and dec are the same slot: the caller passes the function the mode needs
+static const cipher_desc_t modes_func32_cipher = {
+    .name      = "func32",
+    .blocksize = 4,
+    .keysize   = 4,
+    .ctxsize   = sizeof(modes_func32_ctx_t),
+    .enc       = modes_func32_block,
+    .dec       = modes_func32_block,
+};
+
+static const cipher_desc_t modes_func64_cipher = {
+    .name      = "func64",
+    .blocksize = 8,
+    .keysize   = 8,
+    .ctxsize   = sizeof(modes_func64_ctx_t),
+    .enc       = modes_func64_block,
+    .dec       = modes_func64_block,
+};
 
 // ==================== 32-BIT IMPLEMENTATIONS ====================
 
@@ -125,9 +825,8 @@ uint32_t blockscount,
 uint32_t masterkey,
 uint32_t rounds,
 cipher32_func_t enc) {
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_encrypted[i] = enc(data[i], masterkey, rounds);
-    }
+    modes_func32_ctx_t ctx = {enc, masterkey, rounds};
+    ecb_enc(&modes_func32_cipher, &ctx, (uint8_t *)data_encrypted, (const uint8_t *)data, blockscount);
 }
 
 void ecb_dec32(
@@ -137,9 +836,8 @@ uint32_t blockscount,
 uint32_t masterkey,
 uint32_t rounds,
 cipher32_func_t dec) {
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_decrypted[i] = dec(data_encrypted[i], masterkey, rounds);
-    }
+    modes_func32_ctx_t ctx = {dec, masterkey, rounds};
+    ecb_dec(&modes_func32_cipher, &ctx, (uint8_t *)data_decrypted, (const uint8_t *)data_encrypted, blockscount);
 }
 
 void cbc_enc32(
@@ -150,12 +848,8 @@ uint32_t masterkey,
 uint32_t rounds,
 uint32_t iv,
 cipher32_func_t enc) {
-    uint32_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        uint32_t input = data[i] ^ prev;
-        data_encrypted[i] = enc(input, masterkey, rounds);
-        prev = data_encrypted[i];
-    }
+    modes_func32_ctx_t ctx = {enc, masterkey, rounds};
+    cbc_enc(&modes_func32_cipher, &ctx, (uint8_t *)data_encrypted, (const uint8_t *)data, blockscount, (const uint8_t *)&iv);
 }
 
 void cbc_dec32(
@@ -166,12 +860,8 @@ uint32_t masterkey,
 uint32_t rounds,
 uint32_t iv,
 cipher32_func_t dec) {
-    uint32_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        uint32_t decrypted = dec(data_encrypted[i], masterkey, rounds);
-        data_decrypted[i] = decrypted ^ prev;
-        prev = data_encrypted[i];
-    }
+    modes_func32_ctx_t ctx = {dec, masterkey, rounds};
+    cbc_dec(&modes_func32_cipher, &ctx, (uint8_t *)data_decrypted, (const uint8_t *)data_encrypted, blockscount, (const uint8_t *)&iv);
 }
 
 void cfb_enc32(
@@ -182,11 +872,8 @@ uint32_t masterkey,
 uint32_t rounds,
 uint32_t iv,
 cipher32_func_t enc) {
-    uint32_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_encrypted[i] = data[i] ^ enc(prev, masterkey, rounds);
-        prev = data_encrypted[i];
-    }
+    modes_func32_ctx_t ctx = {enc, masterkey, rounds};
+    cfb_enc(&modes_func32_cipher, &ctx, (uint8_t *)data_encrypted, (const uint8_t *)data, blockscount, (const uint8_t *)&iv);
 }
 
 void cfb_dec32(
@@ -197,11 +884,26 @@ uint32_t masterkey,
 uint32_t rounds,
 uint32_t iv,
 cipher32_func_t enc) {
-    uint32_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_decrypted[i] = data_encrypted[i] ^ enc(prev, masterkey, rounds);
-        prev = data_encrypted[i];
+    modes_func32_ctx_t ctx = {enc, masterkey, rounds};
+    cfb_dec(&modes_func32_cipher, &ctx, (uint8_t *)data_decrypted, (const uint8_t *)data_encrypted, blockscount, (const uint8_t *)&iv);
+}
+
+void cbc_enc32_multi(
+cbc_stream32_t *streams,
+uint32_t streamscount,
+uint32_t masterkey,
+uint32_t rounds,
+cipher32_func_t enc) {
+    modes_func32_ctx_t ctx = {enc, masterkey, rounds};
+    cbc_stream_t *generic  = (cbc_stream_t *)malloc(streamscount * sizeof(cbc_stream_t));
+    for (uint32_t i = 0; i < streamscount; ++i) {
+        generic[i].data_encrypted = (uint8_t *)streams[i].data_encrypted;
+        generic[i].data           = (const uint8_t *)streams[i].data;
+        generic[i].blockscount    = streams[i].blockscount;
+        generic[i].iv             = (const uint8_t *)&streams[i].iv;
     }
+    cbc_enc_multi(&modes_func32_cipher, &ctx, generic, streamscount);
+    free(generic);
 }
 
 // ==================== 64-BIT IMPLEMENTATIONS ====================
@@ -213,9 +915,8 @@ uint32_t blockscount,
 uint64_t masterkey,
 uint32_t rounds,
 cipher64_func_t enc) {
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_encrypted[i] = enc(data[i], masterkey, rounds);
-    }
+    modes_func64_ctx_t ctx = {enc, masterkey, rounds};
+    ecb_enc(&modes_func64_cipher, &ctx, (uint8_t *)data_encrypted, (const uint8_t *)data, blockscount);
 }
 
 void ecb_dec64(
@@ -225,9 +926,8 @@ uint32_t blockscount,
 uint64_t masterkey,
 uint32_t rounds,
 cipher64_func_t dec) {
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_decrypted[i] = dec(data_encrypted[i], masterkey, rounds);
-    }
+    modes_func64_ctx_t ctx = {dec, masterkey, rounds};
+    ecb_dec(&modes_func64_cipher, &ctx, (uint8_t *)data_decrypted, (const uint8_t *)data_encrypted, blockscount);
 }
 
 void cbc_enc64(
@@ -238,12 +938,8 @@ uint64_t masterkey,
 uint32_t rounds,
 uint64_t iv,
 cipher64_func_t enc) {
-    uint64_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        uint64_t input = data[i] ^ prev;
-        data_encrypted[i] = enc(input, masterkey, rounds);
-        prev = data_encrypted[i];
-    }
+    modes_func64_ctx_t ctx = {enc, masterkey, rounds};
+    cbc_enc(&modes_func64_cipher, &ctx, (uint8_t *)data_encrypted, (const uint8_t *)data, blockscount, (const uint8_t *)&iv);
 }
 
 void cbc_dec64(
@@ -254,12 +950,8 @@ uint64_t masterkey,
 uint32_t rounds,
 uint64_t iv,
 cipher64_func_t dec) {
-    uint64_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        uint64_t decrypted = dec(data_encrypted[i], masterkey, rounds);
-        data_decrypted[i] = decrypted ^ prev;
-        prev = data_encrypted[i];
-    }
+    modes_func64_ctx_t ctx = {dec, masterkey, rounds};
+    cbc_dec(&modes_func64_cipher, &ctx, (uint8_t *)data_decrypted, (const uint8_t *)data_encrypted, blockscount, (const uint8_t *)&iv);
 }
 
 void cfb_enc64(
@@ -270,11 +962,8 @@ uint64_t masterkey,
 uint32_t rounds,
 uint64_t iv,
 cipher64_func_t enc) {
-    uint64_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_encrypted[i] = data[i] ^ enc(prev, masterkey, rounds);
-        prev = data_encrypted[i];
-    }
+    modes_func64_ctx_t ctx = {enc, masterkey, rounds};
+    cfb_enc(&modes_func64_cipher, &ctx, (uint8_t *)data_encrypted, (const uint8_t *)data, blockscount, (const uint8_t *)&iv);
 }
 
 void cfb_dec64(
@@ -285,13 +974,26 @@ uint64_t masterkey,
 uint32_t rounds,
 uint64_t iv,
 cipher64_func_t enc) {
-    uint64_t prev = iv;
-    for (uint32_t i = 0; i < blockscount; ++i) {
-        data_decrypted[i] = data_encrypted[i] ^ enc(prev, masterkey, rounds);
-        prev = data_encrypted[i];
-    }
+    modes_func64_ctx_t ctx = {enc, masterkey, rounds};
+    cfb_dec(&modes_func64_cipher, &ctx, (uint8_t *)data_decrypted, (const uint8_t *)data_encrypted, blockscount, (const uint8_t *)&iv);
 }
 
-#endif
+void cbc_enc64_multi(
+cbc_stream64_t *streams,
+uint32_t streamscount,
+uint64_t masterkey,
+uint32_t rounds,
+cipher64_func_t enc) {
+    modes_func64_ctx_t ctx = {enc, masterkey, rounds};
+    cbc_stream_t *generic  = (cbc_stream_t *)malloc(streamscount * sizeof(cbc_stream_t));
+    for (uint32_t i = 0; i < streamscount; ++i) {
+        generic[i].data_encrypted = (uint8_t *)streams[i].data_encrypted;
+        generic[i].data           = (const uint8_t *)streams[i].data;
+        generic[i].blockscount    = streams[i].blockscount;
+        generic[i].iv             = (const uint8_t *)&streams[i].iv;
+    }
+    cbc_enc_multi(&modes_func64_cipher, &ctx, generic, streamscount);
+    free(generic);
+}
 
 #endif
@@ -0,0 +1,137 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/* Hardware performance counters around a piece of code (Linux perf_event_open).
+Every counter is opened on its own, so a host that lacks one of them (or a
+container without perf access) still reports the rest; perf_valid tells which */
+
+typedef enum {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS,
+} perf_counter_t;
+
+typedef struct {
+    int fd[PERF_COUNTERS];            // -1 = not available
+    uint64_t values[PERF_COUNTERS];   // filled by perf_stop, scaled if the kernel multiplexed
+    int valid[PERF_COUNTERS];         // set by perf_stop: the read worked and the counter was scheduled
+} perf_t;
+
+// returns the number of counters that could be opened (0 on non-Linux hosts)
+int perf_open(perf_t *p);
+void perf_close(perf_t *p);
+void perf_start(perf_t *p);
+void perf_stop(perf_t *p);
+// whether the last perf_stop got a value for counter (not just an open fd)
+int perf_valid(const perf_t *p, perf_counter_t counter);
+const char *perf_counter_name(perf_counter_t counter);
+
+#ifdef PERF_IMPL
+
+#include <string.h>
+
+static const char *perf_names[PERF_COUNTERS] = {"cycles", "instructions", "l1d-misses", "branch-misses"};
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int perf_open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1; // allowed with perf_event_paranoid <= 2
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perf_open(perf_t *p) {
+    static const uint32_t types[PERF_COUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+    };
+    static const uint64_t configs[PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    int opened = 0;
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        p->fd[i]     = perf_open_counter(types[i], configs[i]);
+        p->values[i] = 0;
+        p->valid[i]  = 0;
+        if (p->fd[i] >= 0) ++opened;
+    }
+    return opened;
+}
+
+void perf_close(perf_t *p) {
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        if (p->fd[i] >= 0) close(p->fd[i]);
+        p->fd[i] = -1;
+    }
+}
+
+void perf_start(perf_t *p) {
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        if (p->fd[i] < 0) continue;
+        ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_stop(perf_t *p) {
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        if (p->fd[i] >= 0) ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        uint64_t data[3]; // value, time enabled, time running
+        p->values[i] = 0;
+        p->valid[i]  = 0;
+        if (p->fd[i] < 0 || read(p->fd[i], data, sizeof(data)) != sizeof(data)) continue;
+        // never scheduled (all slots taken by other events): no value, not a zero count
+        if (data[2] == 0) continue;
+        p->values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+        p->valid[i]  = 1;
+    }
+}
+
+#else
+
+int perf_open(perf_t *p) {
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        p->fd[i]     = -1;
+        p->values[i] = 0;
+        p->valid[i]  = 0;
+    }
+    return 0;
+}
+
+void perf_close(perf_t *p) { (void)p; }
+void perf_start(perf_t *p) { (void)p; }
+void perf_stop(perf_t *p)  { (void)p; }
+
+#endif
+
+int perf_valid(const perf_t *p, perf_counter_t counter) {
+    return p->valid[counter];
+}
+
+const char *perf_counter_name(perf_counter_t counter) {
+    return perf_names[counter];
+}
+
+#endif
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef SECTOR_H
+#define SECTOR_H
+
+#include <stdint.h>
+
+#include "cipher.h"
+
+/* Sector-addressed encryption for block-device images: every sector is
+encrypted on its own (cbc inside the sector), so any sector can be read or
+written without touching its neighbours.
+The iv of a sector is E_tweak(sector number) (ESSIV-style), where the tweak
+key is derived from the master key, so ivs are not predictable without the key */
+
+#define SECTOR_SIZE_DEFAULT 4096
+
+// sectors handled together by one worker (ivs are computed in one batch call)
+#define SECTOR_GROUP 64
+
+typedef struct {
+    const cipher_desc_t *cipher;
+    void *ctx;       // data key
+    void *tweak_ctx; // iv key
+    uint32_t sectorsize;
+} sector_ctx_t;
+
+// one entry of a scatter list: a sector number and its buffers (sectorsize bytes each)
+typedef struct {
+    uint64_t sector;
+    uint8_t *out;
+    const uint8_t *in;
+} sector_io_t;
+
+/* sectorsize must be a multiple of cipher->blocksize.
+The iv input is the sector number in one block, so a cipher with blocks shorter
+than 8 bytes only addresses 2^(8 * blocksize) sectors (2^32 for spnet32):
+larger sector numbers would repeat ivs, the calls below reject them */
+void sector_init(sector_ctx_t *s, const cipher_desc_t *cipher, const uint8_t *key, uint32_t rounds, uint32_t sectorsize);
+void sector_free(sector_ctx_t *s);
+
+// the calls return 0, or -1 without writing anything when a sector number
+// does not fit in the iv (see sector_init) or a range wraps around 2^64
+int sector_enc(const sector_ctx_t *s, uint64_t sector, uint8_t *out, const uint8_t *in);
+int sector_dec(const sector_ctx_t *s, uint64_t sector, uint8_t *out, const uint8_t *in);
+
+// count consecutive sectors starting at first, split across threadscount threads
+int sector_enc_range(const sector_ctx_t *s, uint64_t first, uint64_t count, uint8_t *out, const uint8_t *in, uint32_t threadscount);
+int sector_dec_range(const sector_ctx_t *s, uint64_t first, uint64_t count, uint8_t *out, const uint8_t *in, uint32_t threadscount);
+
+// non-contiguous sectors, split across threadscount threads
+int sector_enc_scatter(const sector_ctx_t *s, const sector_io_t *list, uint64_t count, uint32_t threadscount);
+int sector_dec_scatter(const sector_ctx_t *s, const sector_io_t *list, uint64_t count, uint32_t threadscount);
+
+#ifdef SECTOR_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// sectors are cbc messages of the generic mode layer
+#ifndef CRYPTO_EXTERN_DEPS
+#ifndef MODES_IMPL
+#define MODES_IMPL
+#endif
+#endif
+#include "modes.h"
+
+void sector_init(sector_ctx_t *s, const cipher_desc_t *cipher, const uint8_t *key, uint32_t rounds, uint32_t sectorsize) {
+    if (sectorsize == 0 || sectorsize % cipher->blocksize) {
+        fprintf(stderr, "sector size %u is not a multiple of the %s block size\n", sectorsize, cipher->name);
+        exit(1);
+    }
+    s->cipher     = cipher;
+    s->sectorsize = sectorsize;
+    s->ctx        = malloc(cipher->ctxsize);
+    s->tweak_ctx  = malloc(cipher->ctxsize);
+    cipher->setkey(s->ctx, key, rounds);
+
+    // tweak key = first keysize bytes of E_key(fixed pattern)
+    uint32_t blocks  = (cipher->keysize + cipher->blocksize - 1) / cipher->blocksize;
+    uint8_t *pattern = (uint8_t *)malloc((size_t)blocks * cipher->blocksize);
+    for (uint32_t i = 0; i < blocks * cipher->blocksize; ++i) {
+        pattern[i] = 0x5C ^ i;
+    }
+    cipher_enc_batch(cipher, s->ctx, pattern, pattern, blocks);
+    cipher->setkey(s->tweak_ctx, pattern, rounds);
+    free(pattern);
+}
+
+void sector_free(sector_ctx_t *s) {
+    free(s->ctx);
+    free(s->tweak_ctx);
+    s->ctx       = NULL;
+    s->tweak_ctx = NULL;
+}
+
+// checked by every call before any sector is written
+static int sector_fits(const sector_ctx_t *s, uint64_t sector) {
+    uint32_t bs = s->cipher->blocksize;
+    return bs >= 8 || !(sector >> (8 * bs));
+}
+
+// ivs of count sectors (sector number little-endian in the first bytes of the block)
+static void sector_ivs(const sector_ctx_t *s, const uint64_t *sectors, uint32_t count, uint8_t *ivs) {
+    uint32_t bs = s->cipher->blocksize;
+    memset(ivs, 0, (size_t)count * bs);
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t b = 0; b < 8 && b < bs; ++b) {
+            ivs[i * bs + b] = (uint8_t)(sectors[i] >> (8 * b));
+        }
+    }
+    cipher_enc_batch(s->cipher, s->tweak_ctx, ivs, ivs, count);
+}
+
+int sector_enc(const sector_ctx_t *s, uint64_t sector, uint8_t *out, const uint8_t *in) {
+    if (!sector_fits(s, sector)) return -1;
+    uint8_t iv[CIPHER_MAX_BLOCKSIZE];
+    sector_ivs(s, &sector, 1, iv);
+    cbc_enc(s->cipher, s->ctx, out, in, s->sectorsize / s->cipher->blocksize, iv);
+    return 0;
+}
+
+int sector_dec(const sector_ctx_t *s, uint64_t sector, uint8_t *out, const uint8_t *in) {
+    if (!sector_fits(s, sector)) return -1;
+    uint8_t iv[CIPHER_MAX_BLOCKSIZE];
+    sector_ivs(s, &sector, 1, iv);
+    cbc_dec(s->cipher, s->ctx, out, in, s->sectorsize / s->cipher->blocksize, iv);
+    return 0;
+}
+
+// work of one thread: either a range (list == NULL) or a slice of a scatter list
+typedef struct {
+    const sector_ctx_t *s;
+    const sector_io_t *list;
+    uint64_t first;
+    uint8_t *out;
+    const uint8_t *in;
+    uint64_t begin;
+    uint64_t end;
+    int enc;
+} sector_job_t;
+
+static void *sector_worker(void *arg) {
+    const sector_job_t *job = (const sector_job_t *)arg;
+    const sector_ctx_t *s   = job->s;
+    uint32_t bs             = s->cipher->blocksize;
+    uint32_t blockscount    = s->sectorsize / bs;
+
+    uint64_t sectors[SECTOR_GROUP];
+    uint8_t ivs[SECTOR_GROUP * CIPHER_MAX_BLOCKSIZE];
+    cbc_stream_t streams[SECTOR_GROUP];
+
+    for (uint64_t i = job->begin; i < job->end; i += SECTOR_GROUP) {
+        uint32_t count = job->end - i < SECTOR_GROUP ? (uint32_t)(job->end - i) : SECTOR_GROUP;
+        for (uint32_t k = 0; k < count; ++k) {
+            uint64_t idx = i + k;
+            if (job->list) {
+                sectors[k]                = job->list[idx].sector;
+                streams[k].data_encrypted = job->list[idx].out;
+                streams[k].data           = job->list[idx].in;
+            } else {
+                sectors[k]                = job->first + idx;
+                streams[k].data_encrypted = job->out + idx * s->sectorsize;
+                streams[k].data           = job->in + idx * s->sectorsize;
+            }
+            streams[k].blockscount = blockscount;
+            streams[k].iv          = ivs + k * bs;
+        }
+        sector_ivs(s, sectors, count, ivs);
+
+        if (job->enc) {
+            // cbc encryption is serial inside a sector, so the sectors of a group share the lanes
+            cbc_enc_multi(s->cipher, s->ctx, streams, count);
+        } else {
+            for (uint32_t k = 0; k < count; ++k) {
+                cbc_dec(s->cipher, s->ctx, streams[k].data_encrypted, streams[k].data, blockscount, streams[k].iv);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void sector_run(sector_job_t job, uint64_t count, uint32_t threadscount) {
+    if (threadscount > count) threadscount = (uint32_t)count;
+    if (threadscount <= 1) {
+        job.begin = 0;
+        job.end   = count;
+        sector_worker(&job);
+        return;
+    }
+
+    // resolve the dispatched kernels before the threads start
+    uint8_t block[2 * CIPHER_MAX_BLOCKSIZE] = {0};
+    cipher_enc_batch(job.s->cipher, job.s->ctx, block, block, 1);
+    cipher_dec_batch(job.s->cipher, job.s->ctx, block, block, 1);
+    cipher_xor(block, block, block, sizeof(block));
+
+    pthread_t *threads = (pthread_t *)malloc(threadscount * sizeof(pthread_t));
+    sector_job_t *jobs = (sector_job_t *)malloc(threadscount * sizeof(sector_job_t));
+    for (uint32_t t = 0; t < threadscount; ++t) {
+        jobs[t]       = job;
+        jobs[t].begin = count * t / threadscount;
+        jobs[t].end   = count * (t + 1) / threadscount;
+        if (pthread_create(&threads[t], NULL, sector_worker, &jobs[t])) {
+            // no thread: do this slice here
+            sector_worker(&jobs[t]);
+            threads[t] = pthread_self();
+        }
+    }
+    for (uint32_t t = 0; t < threadscount; ++t) {
+        if (!pthread_equal(threads[t], pthread_self())) pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    free(jobs);
+}
+
+// the last sector of a range bounds all of them
+static int sector_range_fits(const sector_ctx_t *s, uint64_t first, uint64_t count) {
+    if (count == 0) return 1;
+    uint64_t last = first + (count - 1);
+    return last >= first && sector_fits(s, last);
+}
+
+static int sector_list_fits(const sector_ctx_t *s, const sector_io_t *list, uint64_t count) {
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!sector_fits(s, list[i].sector)) return 0;
+    }
+    return 1;
+}
+
+int sector_enc_range(const sector_ctx_t *s, uint64_t first, uint64_t count, uint8_t *out, const uint8_t *in, uint32_t threadscount) {
+    if (!sector_range_fits(s, first, count)) return -1;
+    sector_job_t job = {s, NULL, first, out, in, 0, 0, 1};
+    sector_run(job, count, threadscount);
+    return 0;
+}
+
+int sector_dec_range(const sector_ctx_t *s, uint64_t first, uint64_t count, uint8_t *out, const uint8_t *in, uint32_t threadscount) {
+    if (!sector_range_fits(s, first, count)) return -1;
+    sector_job_t job = {s, NULL, first, out, in, 0, 0, 0};
+    sector_run(job, count, threadscount);
+    return 0;
+}
+
+int sector_enc_scatter(const sector_ctx_t *s, const sector_io_t *list, uint64_t count, uint32_t threadscount) {
+    if (!sector_list_fits(s, list, count)) return -1;
+    sector_job_t job = {s, list, 0, NULL, NULL, 0, 0, 1};
+    sector_run(job, count, threadscount);
+    return 0;
+}
+
+int sector_dec_scatter(const sector_ctx_t *s, const sector_io_t *list, uint64_t count, uint32_t threadscount) {
+    if (!sector_list_fits(s, list, count)) return -1;
+    sector_job_t job = {s, list, 0, NULL, NULL, 0, 0, 0};
+    sector_run(job, count, threadscount);
+    return 0;
+}
+
+#endif
+
+#endif
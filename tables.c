@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DISPATCH_IMPL
+#define CIPHER_IMPL
+#define SPNET_IMPL
+#define FEISTEL_SPNET_IMPL
+#define DES_IMPL
+#define ANALYSIS_IMPL
+
+#include "dispatch.h"
+#include "cipher.h"
+#include "ciphers/spnet.h"
+#include "ciphers/feistel_spnet.h"
+#include "ciphers/des.h"
+#include "analysis.h"
+
+/* DDT / LAT of the S-boxes and the 16-bit round function of the project:
+  spnet32_sbox     4 -> 4 bits, the S-box of spnet32 and feistel_spnet32
+  des_s1 .. des_s8 6 -> 4 bits
+  feistel_round16  16 -> 16 bits, F(x, k = 0) of feistel_spnet32
+                   (a round key xored before the S-boxes leaves the DDT unchanged,
+                   substitute y = x ^ k, and multiplies LAT entry (a, b) by (-1)^(a.k),
+                   so k = 0 gives the same summary for every key)
+With --out PREFIX the tables go to PREFIX<name>.ddt and PREFIX<name>.lat (format in analysis.h).
+
+usage: ./tables.out [function ...] [--threads T] [--out PREFIX] [--no-ddt] [--no-lat] */
+
+#define TABLES_FUNCS 10
+
+static uint16_t tables_spnet32[16];
+static uint16_t tables_des[8][64];
+static uint16_t tables_round16[1 << 16];
+
+static uint32_t tables_build(analysis_func_t *funcs, char names[][16]) {
+    uint32_t count = 0;
+
+    for (uint32_t x = 0; x < 16; ++x) tables_spnet32[x] = (uint16_t)SP_net32_sbox(x);
+    funcs[count++] = (analysis_func_t){"spnet32_sbox", 4, 4, tables_spnet32};
+
+    for (uint32_t box = 0; box < 8; ++box) {
+        for (uint32_t x = 0; x < 64; ++x) tables_des[box][x] = des_sbox(box, x);
+        snprintf(names[box], 16, "des_s%u", box + 1);
+        funcs[count++] = (analysis_func_t){names[box], 6, 4, tables_des[box]};
+    }
+
+    for (uint32_t x = 0; x < (1 << 16); ++x) tables_round16[x] = feistel_SP_net32_round16((uint16_t)x, 0);
+    funcs[count++] = (analysis_func_t){"feistel_round16", 16, 16, tables_round16};
+    return count;
+}
+
+static double tables_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static FILE *tables_open(const char *prefix, const char *name, const char *ext) {
+    if (!prefix) return NULL;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s.%s", prefix, name, ext);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        exit(1);
+    }
+    return f;
+}
+
+int main(int argc, char **argv) {
+    long threadscount  = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *prefix = NULL;
+    int ddt = 1, lat = 1;
+    const char *selected[TABLES_FUNCS];
+    int selectedcount = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc)  threadscount = strtol(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) prefix = argv[++i];
+        else if (!strcmp(argv[i], "--no-ddt"))              ddt = 0;
+        else if (!strcmp(argv[i], "--no-lat"))              lat = 0;
+        else if (selectedcount < TABLES_FUNCS)              selected[selectedcount++] = argv[i];
+    }
+    if (threadscount < 1) threadscount = 1;
+
+    analysis_func_t funcs[TABLES_FUNCS];
+    char names[8][16];
+    uint32_t count = tables_build(funcs, names);
+
+    for (int s = 0; s < selectedcount; ++s) {
+        int known = 0;
+        for (uint32_t i = 0; i < count; ++i) known |= !strcmp(selected[s], funcs[i].name);
+        if (!known) {
+            fprintf(stderr, "unknown function %s\n", selected[s]);
+            return 1;
+        }
+    }
+
+    printf("%-16s %7s %8s %14s %10s %8s %14s %10s %8s\n",
+        "function", "bits", "max ddt", "(a, b)", "max dp", "max lat", "(a, b)", "max bias", "seconds");
+    for (uint32_t i = 0; i < count; ++i) {
+        const analysis_func_t *f = &funcs[i];
+        int wanted = selectedcount == 0;
+        for (int s = 0; s < selectedcount; ++s) wanted |= !strcmp(selected[s], f->name);
+        if (!wanted) continue;
+
+        analysis_summary_t summary;
+        memset(&summary, 0, sizeof(summary));
+        double start = tables_now();
+        if (ddt) {
+            FILE *out = tables_open(prefix, f->name, "ddt");
+            analysis_ddt(f, NULL, out, &summary, (uint32_t)threadscount);
+            if (out) fclose(out);
+        }
+        if (lat) {
+            FILE *out = tables_open(prefix, f->name, "lat");
+            analysis_lat(f, NULL, out, &summary, (uint32_t)threadscount);
+            if (out) fclose(out);
+        }
+        double elapsed = tables_now() - start;
+
+        char bits[16], ddt_at[32], lat_at[32];
+        snprintf(bits, sizeof(bits), "%u->%u", f->inbits, f->outbits);
+        snprintf(ddt_at, sizeof(ddt_at), "(%#x, %#x)", summary.max_ddt_a, summary.max_ddt_b);
+        snprintf(lat_at, sizeof(lat_at), "(%#x, %#x)", summary.max_lat_a, summary.max_lat_b);
+        printf("%-16s %7s", f->name, bits);
+        if (ddt) printf(" %8u %14s %10.6f", summary.max_ddt, ddt_at, summary.max_dp);
+        else     printf(" %8s %14s %10s", "-", "-", "-");
+        if (lat) printf(" %8u %14s %10.6f", summary.max_lat, lat_at, summary.max_bias);
+        else     printf(" %8s %14s %10s", "-", "-", "-");
+        printf(" %8.2f\n", elapsed);
+        fflush(stdout);
+    }
+
+    dispatch_report(stdout);
+    return 0;
+}
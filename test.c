@@ -3,15 +3,23 @@
 #include <assert.h>
 #include <string.h>
 
+#define DISPATCH_IMPL
+#define CIPHER_IMPL
 #define MODES_IMPL
 #define SPNET_IMPL
 #define FEISTEL_SPNET_IMPL
 #define DES_IMPL
+#define SECTOR_IMPL
+#define ANALYSIS_IMPL
 
+#include "dispatch.h"
+#include "cipher.h"
 #include "modes.h"
 #include "ciphers/spnet.h"
 #include "ciphers/feistel_spnet.h"
 #include "ciphers/des.h"
+#include "sector.h"
+#include "analysis.h"
 
 #define RUN_TEST(test_fn) \
     do { \
@@ -102,9 +110,449 @@ void test_spnet32() {
     assert(!strcmp(text, decrypted) && "spnet32 cfb failed");
 }
 
+void test_cbc_multi() {
+    uint32_t key32  = 0xCAFEBABE;
+    uint64_t key64  = 0xDEADBABEDEADBABE;
+
+    // more streams than lanes, different lengths (including empty ones)
+    uint32_t data32[20][7], encrypted32[20][7], expected32[20][7];
+    uint64_t data64[20][7], encrypted64[20][7], expected64[20][7];
+    cbc_stream32_t streams32[20];
+    cbc_stream64_t streams64[20];
+    for (uint32_t s = 0; s < 20; ++s) {
+        for (uint32_t i = 0; i < 7; ++i) {
+            data32[s][i] = s * 0x01010101 + i;
+            data64[s][i] = s * 0x0101010101010101 + i;
+        }
+        uint32_t blockscount = (s * 5) % 8;
+        streams32[s] = (cbc_stream32_t){encrypted32[s], data32[s], blockscount, 0xDEADBEEF + s};
+        streams64[s] = (cbc_stream64_t){encrypted64[s], data64[s], blockscount, 0x1337133713371337 + s};
+        cbc_enc32(expected32[s], data32[s], blockscount, key32, 5, streams32[s].iv, SP_net32_enc);
+        cbc_enc64(expected64[s], data64[s], blockscount, key64, 16, streams64[s].iv, des_enc);
+    }
+
+    cbc_enc32_multi(streams32, 20, key32, 5, SP_net32_enc);
+    cbc_enc64_multi(streams64, 20, key64, 16, des_enc);
+    for (uint32_t s = 0; s < 20; ++s) {
+        uint32_t blockscount = streams32[s].blockscount;
+        assert(!memcmp(encrypted32[s], expected32[s], blockscount * 4) && "cbc multi 32 failed");
+        assert(!memcmp(encrypted64[s], expected64[s], blockscount * 8) && "cbc multi 64 failed");
+    }
+}
+
+void test_cipher_descriptors() {
+    assert(!cipher_register(&SP_net32_cipher));
+    assert(!cipher_register(&feistel_SP_net32_cipher));
+    assert(!cipher_register(&des_cipher));
+    assert(cipher_register(&des_cipher) == -1 && "duplicate name registered");
+    assert(cipher_count() == 3);
+    assert(!cipher_find("aes"));
+
+    // generic modes through the descriptor must match the fixed-width api
+    const char *names[] = {"spnet32", "feistel_spnet32", "des"};
+    cipher64_func_t funcs64[][2] = {{NULL, NULL}, {NULL, NULL}, {des_enc, des_dec}};
+    cipher32_func_t funcs32[][2] = {{SP_net32_enc, SP_net32_dec}, {feistel_SP_net32_enc, feistel_SP_net32_dec}, {NULL, NULL}};
+
+    uint8_t key[8] = {0xBE, 0xBA, 0xFE, 0xCA, 0xBE, 0xBA, 0xAD, 0xDE};
+    uint8_t iv[8]  = {0xEF, 0xBE, 0xAD, 0xDE, 0x37, 0x13, 0x37, 0x13};
+    uint8_t text[600], encrypted[600], expected[600], decrypted[600]; // crosses MODES_CHUNK_BLOCKS
+    for (uint32_t i = 0; i < sizeof(text); ++i) text[i] = i * 7 + 1;
+
+    for (uint32_t c = 0; c < 3; ++c) {
+        const cipher_desc_t *cipher = cipher_find(names[c]);
+        assert(cipher && !strcmp(cipher->name, names[c]));
+        uint32_t rounds      = cipher->default_rounds;
+        uint32_t blockscount = sizeof(text) / cipher->blocksize;
+        void *ctx            = malloc(cipher->ctxsize);
+        cipher->setkey(ctx, key, rounds);
+
+        uint32_t key32, iv32;
+        uint64_t key64, iv64;
+        memcpy(&key32, key, 4); memcpy(&iv32, iv, 4);
+        memcpy(&key64, key, 8); memcpy(&iv64, iv, 8);
+
+        // ecb
+        ecb_enc(cipher, ctx, encrypted, text, blockscount);
+        if (cipher->blocksize == 4) ecb_enc32((uint32_t *)expected, (uint32_t *)text, blockscount, key32, rounds, funcs32[c][0]);
+        else                        ecb_enc64((uint64_t *)expected, (uint64_t *)text, blockscount, key64, rounds, funcs64[c][0]);
+        assert(!memcmp(encrypted, expected, blockscount * cipher->blocksize) && "generic ecb enc mismatch");
+        ecb_dec(cipher, ctx, decrypted, encrypted, blockscount);
+        assert(!memcmp(decrypted, text, blockscount * cipher->blocksize) && "generic ecb failed");
+
+        // cbc
+        cbc_enc(cipher, ctx, encrypted, text, blockscount, iv);
+        if (cipher->blocksize == 4) cbc_enc32((uint32_t *)expected, (uint32_t *)text, blockscount, key32, rounds, iv32, funcs32[c][0]);
+        else                        cbc_enc64((uint64_t *)expected, (uint64_t *)text, blockscount, key64, rounds, iv64, funcs64[c][0]);
+        assert(!memcmp(encrypted, expected, blockscount * cipher->blocksize) && "generic cbc enc mismatch");
+        memcpy(decrypted, encrypted, sizeof(encrypted));
+        cbc_dec(cipher, ctx, decrypted, decrypted, blockscount, iv); // in-place
+        assert(!memcmp(decrypted, text, blockscount * cipher->blocksize) && "generic cbc failed");
+
+        // cfb
+        cfb_enc(cipher, ctx, encrypted, text, blockscount, iv);
+        if (cipher->blocksize == 4) cfb_enc32((uint32_t *)expected, (uint32_t *)text, blockscount, key32, rounds, iv32, funcs32[c][0]);
+        else                        cfb_enc64((uint64_t *)expected, (uint64_t *)text, blockscount, key64, rounds, iv64, funcs64[c][0]);
+        assert(!memcmp(encrypted, expected, blockscount * cipher->blocksize) && "generic cfb enc mismatch");
+        memcpy(decrypted, encrypted, sizeof(encrypted));
+        cfb_dec(cipher, ctx, decrypted, decrypted, blockscount, iv); // in-place
+        assert(!memcmp(decrypted, text, blockscount * cipher->blocksize) && "generic cfb failed");
+
+        free(ctx);
+    }
+}
+
+void test_dispatch() {
+    SP_net32_ctx_t ctx;
+    SP_net32_init(&ctx, 0xCAFEBABE, 5);
+
+    // batch kernels (whatever this cpu picked) must match the per-block code, including the tails
+    uint32_t text[101], encrypted[102], decrypted[101];
+    for (uint32_t i = 0; i < 101; ++i) text[i] = i * 0x9E3779B9;
+    for (uint32_t n = 0; n <= 101; n += 3) {
+        encrypted[n] = 0x5A5A5A5A; // masked tails must not write past the last block
+        cipher_enc_batch(&SP_net32_cipher, &ctx, (uint8_t *)encrypted, (const uint8_t *)text, n);
+        assert(encrypted[n] == 0x5A5A5A5A && "spnet32 batch wrote past the end");
+        for (uint32_t i = 0; i < n; ++i) {
+            assert(encrypted[i] == SP_net32_enc_block(&ctx, text[i]) && "spnet32 batch enc mismatch");
+        }
+        cipher_dec_batch(&SP_net32_cipher, &ctx, (uint8_t *)decrypted, (const uint8_t *)encrypted, n);
+        assert(!memcmp(decrypted, text, n * 4) && "spnet32 batch dec failed");
+    }
+
+    uint8_t a[200], b[200], c[200];
+    for (uint32_t i = 0; i < 200; ++i) { a[i] = i; b[i] = i * 31 + 7; }
+    for (uint32_t len = 0; len <= 200; len += 13) {
+        cipher_xor(c, a, b, len);
+        for (uint32_t i = 0; i < len; ++i) assert(c[i] == (a[i] ^ b[i]) && "cipher_xor failed");
+    }
+}
+
+void test_keyed() {
+    // batched key schedules must match the one-key-at-a-time ones (100 keys = one full pass + tail)
+    uint64_t keys64[100];
+    uint32_t keys32[100];
+    for (uint32_t i = 0; i < 100; ++i) {
+        keys64[i] = 0x0123456789ABCDEF * (i + 1) ^ ((uint64_t)i << 59);
+        keys32[i] = (uint32_t)(keys64[i] >> 16);
+    }
+
+    static des_ctx_t des_ctxs[100];
+    static SP_net32_ctx_t spnet_ctxs[100];
+    static feistel_SP_net32_ctx_t feistel_ctxs[100];
+    des_init_batch(des_ctxs, keys64, 100, 16);
+    SP_net32_init_batch(spnet_ctxs, keys32, 100, 7);
+    feistel_SP_net32_init_batch(feistel_ctxs, keys32, 100, 7);
+    for (uint32_t i = 0; i < 100; ++i) {
+        des_ctx_t des_ctx;
+        SP_net32_ctx_t spnet_ctx;
+        feistel_SP_net32_ctx_t feistel_ctx;
+        des_init(&des_ctx, keys64[i], 16);
+        SP_net32_init(&spnet_ctx, keys32[i], 7);
+        feistel_SP_net32_init(&feistel_ctx, keys32[i], 7);
+        assert(!memcmp(&des_ctx, &des_ctxs[i], sizeof(des_ctx)) && "des batch key schedule mismatch");
+        assert(!memcmp(spnet_ctx.roundkeys, spnet_ctxs[i].roundkeys, 7 * 4) && "spnet32 batch key schedule mismatch");
+        assert(!memcmp(feistel_ctx.roundkeys, feistel_ctxs[i].roundkeys, 7 * 2) && "feistel batch key schedule mismatch");
+    }
+
+    // the vector schedules: full vectors, tails, and rounds past 32 (the rotation wraps)
+    static const uint32_t rounds[] = {1, 5, 16, 17, 40, 64};
+    for (uint32_t r = 0; r < sizeof(rounds) / sizeof(rounds[0]); ++r) {
+        SP_net32_init_batch(spnet_ctxs, keys32, 100, rounds[r]);
+        feistel_SP_net32_init_batch(feistel_ctxs, keys32, 100, rounds[r]);
+        for (uint32_t i = 0; i < 100; ++i) {
+            SP_net32_ctx_t spnet_ctx;
+            feistel_SP_net32_ctx_t feistel_ctx;
+            SP_net32_init(&spnet_ctx, keys32[i], rounds[r]);
+            feistel_SP_net32_init(&feistel_ctx, keys32[i], rounds[r]);
+            assert(spnet_ctxs[i].rounds == rounds[r] && feistel_ctxs[i].rounds == rounds[r]);
+            assert(!memcmp(spnet_ctx.roundkeys, spnet_ctxs[i].roundkeys, rounds[r] * 4) && "spnet32 vector key schedule mismatch");
+            assert(!memcmp(feistel_ctx.roundkeys, feistel_ctxs[i].roundkeys, rounds[r] * 2) && "feistel vector key schedule mismatch");
+        }
+    }
+
+    // per-record keys: every record must equal cbc/ecb under its own key
+    uint64_t text[100][3], encrypted[100][3], decrypted[100][3], expected[3];
+    uint64_t iv = 0x1337133713371337;
+    mode_record_t records[100];
+    for (uint32_t i = 0; i < 100; ++i) {
+        for (uint32_t b = 0; b < 3; ++b) text[i][b] = i * 1000 + b;
+        records[i] = (mode_record_t){(uint8_t *)encrypted[i], (const uint8_t *)text[i], i % 4, (const uint8_t *)&iv};
+    }
+
+    cbc_enc_keyed(&des_cipher, 16, (const uint8_t *)keys64, records, 100);
+    for (uint32_t i = 0; i < 100; ++i) {
+        cbc_enc64(expected, text[i], records[i].blockscount, keys64[i], 16, iv, des_enc);
+        assert(!memcmp(expected, encrypted[i], records[i].blockscount * 8) && "cbc keyed enc mismatch");
+        records[i].out = (uint8_t *)decrypted[i];
+        records[i].in  = (const uint8_t *)encrypted[i];
+    }
+    cbc_dec_keyed(&des_cipher, 16, (const uint8_t *)keys64, records, 100);
+    for (uint32_t i = 0; i < 100; ++i) {
+        assert(!memcmp(text[i], decrypted[i], records[i].blockscount * 8) && "cbc keyed failed");
+        records[i].out = (uint8_t *)encrypted[i];
+        records[i].in  = (const uint8_t *)text[i];
+    }
+
+    ecb_enc_keyed(&des_cipher, 16, (const uint8_t *)keys64, records, 100);
+    for (uint32_t i = 0; i < 100; ++i) {
+        ecb_enc64(expected, text[i], records[i].blockscount, keys64[i], 16, des_enc);
+        assert(!memcmp(expected, encrypted[i], records[i].blockscount * 8) && "ecb keyed enc mismatch");
+        records[i].out = (uint8_t *)decrypted[i];
+        records[i].in  = (const uint8_t *)encrypted[i];
+    }
+    ecb_dec_keyed(&des_cipher, 16, (const uint8_t *)keys64, records, 100);
+    for (uint32_t i = 0; i < 100; ++i) {
+        assert(!memcmp(text[i], decrypted[i], records[i].blockscount * 8) && "ecb keyed failed");
+    }
+}
+
+void test_sector() {
+    uint8_t key[8]       = {0xBE, 0xBA, 0xAD, 0xDE, 0xBE, 0xBA, 0xAD, 0xDE};
+    uint32_t sectorsize  = 512;
+    uint32_t sectors     = 150;
+    uint8_t *image       = (uint8_t *)malloc(sectors * sectorsize);
+    uint8_t *encrypted   = (uint8_t *)malloc(sectors * sectorsize);
+    uint8_t *decrypted   = (uint8_t *)malloc(sectors * sectorsize);
+    memset(image, 0xAB, sectors * sectorsize); // same plaintext in every sector
+
+    const cipher_desc_t *ciphers[] = {&SP_net32_cipher, &des_cipher};
+    for (uint32_t c = 0; c < 2; ++c) {
+        sector_ctx_t s;
+        sector_init(&s, ciphers[c], key, ciphers[c]->default_rounds, sectorsize);
+
+        // a range on 4 threads must match sector-by-sector encryption
+        assert(!sector_enc_range(&s, 1000, sectors, encrypted, image, 4));
+        uint8_t one[512];
+        for (uint32_t i = 0; i < sectors; i += 7) {
+            assert(!sector_enc(&s, 1000 + i, one, image + i * sectorsize));
+            assert(!memcmp(one, encrypted + i * sectorsize, sectorsize) && "sector range enc mismatch");
+        }
+        assert(memcmp(encrypted, encrypted + sectorsize, sectorsize) && "equal sectors must differ");
+
+        assert(!sector_dec_range(&s, 1000, sectors, decrypted, encrypted, 3));
+        assert(!memcmp(decrypted, image, sectors * sectorsize) && "sector range failed");
+
+        // scatter list in reverse order, single sector read back
+        sector_io_t list[10];
+        for (uint32_t i = 0; i < 10; ++i) {
+            uint32_t idx = 9 - i;
+            list[i] = (sector_io_t){1000 + idx * 13, decrypted + idx * sectorsize, encrypted + idx * 13 * sectorsize};
+        }
+        assert(!sector_dec_scatter(&s, list, 10, 2));
+        assert(!memcmp(decrypted, image, 10 * sectorsize) && "sector scatter failed");
+        assert(!sector_dec(&s, 1000 + 42, one, encrypted + 42 * sectorsize));
+        assert(!memcmp(one, image, sectorsize) && "sector dec failed");
+
+        // sector numbers past the iv (2^32 for 4-byte blocks) or a range wrapping
+        // around 2^64 are refused before anything is written
+        int narrow = ciphers[c]->blocksize < 8;
+        memset(decrypted, 0, sectors * sectorsize);
+        assert(sector_dec_range(&s, (1ULL << 32) - 2, sectors, decrypted, encrypted, 3) == -narrow);
+        assert(sector_dec_range(&s, UINT64_MAX - 1, sectors, decrypted, encrypted, 3) == -1);
+        list[9].sector = 1ULL << 32;
+        assert(sector_dec_scatter(&s, list, 10, 2) == -narrow);
+        assert(sector_enc(&s, UINT64_MAX, one, image) == -narrow);
+        if (narrow) {
+            for (uint32_t i = 0; i < sectors * sectorsize; ++i) assert(!decrypted[i] && "refused call must not write");
+        }
+
+        sector_free(&s);
+    }
+    free(image);
+    free(encrypted);
+    free(decrypted);
+}
+
+void test_fixed_rounds() {
+    // known answers of the original loop-over-rounds code; 6 rounds has no specialization
+    static const uint32_t known[][3] = {
+        {4 , 0xB19AC9C1, 0x152C9F5B},
+        {5 , 0x658FFED6, 0xDE84152C},
+        {6 , 0x20ADF5D9, 0xE06BDE84},
+        {8 , 0xC793A14C, 0x04B1936F},
+        {16, 0xD01B3598, 0x9C6AB3E5},
+    };
+    uint32_t block = 0xCAFEBABE, key = 0xDEADBEEF;
+    for (uint32_t i = 0; i < 5; ++i) {
+        uint32_t rounds = known[i][0];
+        SP_net32_ctx_t ctx;
+        feistel_SP_net32_ctx_t feistel_ctx;
+        SP_net32_init(&ctx, key, rounds);
+        feistel_SP_net32_init(&feistel_ctx, key, rounds);
+
+        assert(SP_net32_enc(block, key, rounds) == known[i][1] && "spnet32 known answer failed");
+        assert(SP_net32_enc_block(&ctx, block) == known[i][1] && "spnet32 ctx known answer failed");
+        assert(SP_net32_dec(known[i][1], key, rounds) == block && "spnet32 dec failed");
+        assert(SP_net32_dec_block(&ctx, known[i][1]) == block && "spnet32 ctx dec failed");
+
+        assert(feistel_SP_net32_enc(block, key, rounds) == known[i][2] && "feistel known answer failed");
+        assert(feistel_SP_net32_enc_block(&feistel_ctx, block) == known[i][2] && "feistel ctx known answer failed");
+        assert(feistel_SP_net32_dec(known[i][2], key, rounds) == block && "feistel dec failed");
+        assert(feistel_SP_net32_dec_block(&feistel_ctx, known[i][2]) == block && "feistel ctx dec failed");
+    }
+    assert(SP_net32_enc_r5(block, key) == 0x658FFED6 && "spnet32 r5 failed");
+    assert(feistel_SP_net32_dec_r16(0x9C6AB3E5, key) == block && "feistel r16 failed");
+    assert(des_enc(0xCAFECAFECAFECAFE, 0xDEADBABEDEADBABE, 16) == 0x76CEA8CC321AC662 && "des known answer failed");
+}
+
+void test_analysis() {
+    // DES S5 (6 -> 4 bits), checked entry by entry against the definitions
+    uint16_t table[64];
+    for (uint32_t x = 0; x < 64; ++x) table[x] = des_sbox(4, x);
+    analysis_func_t f = {"des_s5", 6, 4, table};
+
+    uint32_t ddt[64 * 16];
+    int32_t lat[16 * 64];
+    analysis_summary_t summary;
+    FILE *out = tmpfile();
+    analysis_ddt(&f, ddt, NULL, &summary, 3);
+    analysis_lat(&f, lat, out, &summary, 3);
+
+    for (uint32_t a = 0; a < 64; ++a) {
+        for (uint32_t b = 0; b < 16; ++b) {
+            uint32_t count = 0, agree = 0;
+            for (uint32_t x = 0; x < 64; ++x) {
+                count += (table[x] ^ table[x ^ a]) == b;
+                agree += (__builtin_popcount(a & x) & 1) == (__builtin_popcount(b & table[x]) & 1);
+            }
+            assert(ddt[a * 16 + b] == count && "ddt entry mismatch");
+            assert(lat[b * 64 + a] == (int32_t)agree - 32 && "lat entry mismatch");
+        }
+    }
+    // Matsui's best approximation of S5: 12 of 64 agree for masks (0x10, 0xF)
+    assert(lat[0xF * 64 + 0x10] == -20 && "des s5 lat known entry failed");
+    assert(summary.max_lat == 20 && summary.max_lat_a == 0x10 && summary.max_lat_b == 0xF && "lat summary failed");
+    assert(summary.max_ddt == 16 && summary.max_dp == 0.25 && "ddt summary failed");
+
+    // binary file: header, then int16 entries in the same order
+    analysis_file_header_t header;
+    int16_t entries[16 * 64];
+    rewind(out);
+    assert(fread(&header, sizeof(header), 1, out) == 1 && !memcmp(header.magic, "LAT1", 4) && header.entrysize == 2);
+    assert(fread(entries, 2, 16 * 64, out) == 16 * 64 && "lat file too short");
+    for (uint32_t i = 0; i < 16 * 64; ++i) assert(entries[i] == lat[i] && "lat file mismatch");
+    fclose(out);
+
+    // the vector transform must match the scalar one
+    int32_t v[1024], w[1024];
+    for (uint32_t i = 0; i < 1024; ++i) v[i] = w[i] = (int32_t)(i * 2654435761u >> 20) - 2048;
+    analysis_wht_scalar(v, 1024);
+    analysis_wht_kernel(w, 1024);
+    assert(!memcmp(v, w, sizeof(v)) && "wht kernel mismatch");
+}
+
+void test_mode_job() {
+    static const mode_op_t ops[][2] = {
+        {MODES_ECB_ENC, MODES_ECB_DEC},
+        {MODES_CBC_ENC, MODES_CBC_DEC},
+        {MODES_CFB_ENC, MODES_CFB_DEC},
+    };
+    uint8_t key[8]  = {0xDE, 0xAD, 0xBA, 0xBE, 0xDE, 0xAD, 0xBA, 0xBE};
+    uint8_t iv[8]   = {0x13, 0x37, 0x13, 0x37, 0x13, 0x37, 0x13, 0x37};
+    uint32_t blockscount = 1000;
+    uint8_t data[8000], expected[8000], buf[8000];
+    for (uint32_t i = 0; i < sizeof(data); ++i) data[i] = (uint8_t)(i * 31 + 5);
+
+    des_ctx_t ctx;
+    des_cipher.setkey(&ctx, key, DES_ROUNDS);
+    for (uint32_t m = 0; m < 3; ++m) {
+        switch (ops[m][0]) {
+        case MODES_CBC_ENC: cbc_enc(&des_cipher, &ctx, expected, data, blockscount, iv); break;
+        case MODES_CFB_ENC: cfb_enc(&des_cipher, &ctx, expected, data, blockscount, iv); break;
+        default:            ecb_enc(&des_cipher, &ctx, expected, data, blockscount);     break;
+        }
+
+        // small block budgets (not a multiple of the chunk size) must give the one-shot result
+        mode_job_t job;
+        mode_job_init(&job, &des_cipher, &ctx, ops[m][0], buf, data, blockscount, iv);
+        uint32_t steps = 0;
+        while (!mode_job_step(&job, 7, 0)) {
+            assert(job.done == 7 * ++steps && "job step budget not honoured");
+        }
+        assert(job.done == blockscount && !memcmp(buf, expected, sizeof(buf)) && "job enc mismatch");
+        assert(mode_job_step(&job, 7, 0) && "finished job must stay finished");
+
+        // in-place decryption under a time budget: without a measured rate the
+        // first step does a single block, later steps start from the job's rate;
+        // a build without a monotonic clock refuses time budgets
+        mode_job_init(&job, &des_cipher, &ctx, ops[m][1], buf, buf, blockscount, iv);
+        if (MODES_JOB_CLOCK) {
+            assert(!mode_job_step(&job, 0, 1) && job.done == 1 && job.block_ps && "first timed step must probe one block");
+            while (!mode_job_step(&job, 0, 1000)) {}
+        } else {
+            assert(mode_job_step(&job, 0, 1000) == -1 && job.done == 0 && "time budget without a clock must be refused");
+            while (!mode_job_step(&job, 64, 0)) {}
+        }
+        assert(!memcmp(buf, data, sizeof(buf)) && "job dec mismatch");
+    }
+}
+
+void test_enc_mac() {
+    const cipher_desc_t *ciphers[] = {&SP_net32_cipher, &des_cipher};
+    uint8_t enc_key[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t mac_key[8] = {9, 10, 11, 12, 13, 14, 15, 16};
+    uint8_t iv[8]      = {0x13, 0x37, 0x13, 0x37, 0x13, 0x37, 0x13, 0x37};
+    uint8_t data[4000], encrypted[4000], decrypted[4000], expected[4000];
+    for (uint32_t i = 0; i < sizeof(data); ++i) data[i] = (uint8_t)(i * 7 + 3);
+
+    for (uint32_t c = 0; c < 2; ++c) {
+        const cipher_desc_t *cipher = ciphers[c];
+        uint32_t bs = cipher->blocksize, blockscount = sizeof(data) / bs;
+        uint8_t enc_ctx[sizeof(des_ctx_t) + sizeof(SP_net32_ctx_t)], mac_ctx[sizeof(enc_ctx)];
+        cipher->setkey(enc_ctx, enc_key, cipher->default_rounds);
+        cipher->setkey(mac_ctx, mac_key, cipher->default_rounds);
+
+        // same ciphertext as cbc_enc, tag = cbc-mac of (length, iv, ciphertext)
+        uint8_t tag[8], state[8] = {0};
+        cbc_enc_mac(cipher, enc_ctx, mac_ctx, encrypted, data, blockscount, iv, tag);
+        cbc_enc(cipher, enc_ctx, expected, data, blockscount, iv);
+        assert(!memcmp(encrypted, expected, sizeof(data)) && "enc_mac ciphertext mismatch");
+        for (uint32_t b = 0; b < 4; ++b) state[b] = (uint8_t)(blockscount >> (8 * b));
+        cipher->enc(mac_ctx, state, state);
+        cipher_xor(state, state, iv, bs);
+        cipher->enc(mac_ctx, state, state);
+        for (uint32_t i = 0; i < blockscount; ++i) {
+            cipher_xor(state, state, expected + i * bs, bs);
+            cipher->enc(mac_ctx, state, state);
+        }
+        assert(!memcmp(state, tag, bs) && "enc_mac tag mismatch");
+
+        for (int flags = 0; flags <= MODES_VERIFY_FIRST; ++flags) {
+            assert(cbc_dec_verify(cipher, enc_ctx, mac_ctx, decrypted, encrypted, blockscount, iv, tag, flags) == 0);
+            assert(!memcmp(decrypted, data, sizeof(data)) && "dec_verify failed");
+
+            // one flipped ciphertext bit: rejected, no plaintext left in the output
+            memset(decrypted, 0xAA, sizeof(decrypted));
+            encrypted[1234] ^= 0x10;
+            assert(cbc_dec_verify(cipher, enc_ctx, mac_ctx, decrypted, encrypted, blockscount, iv, tag, flags) == -1);
+            encrypted[1234] ^= 0x10;
+            for (uint32_t i = 0; i < sizeof(decrypted); ++i) {
+                assert(decrypted[i] == (flags ? 0xAA : 0) && "rejected plaintext was released");
+            }
+            // a truncated message does not verify under the full tag
+            assert(cbc_dec_verify(cipher, enc_ctx, mac_ctx, decrypted, encrypted, blockscount - 1, iv, tag, flags) == -1);
+        }
+
+        // in place
+        memcpy(decrypted, encrypted, sizeof(data));
+        assert(cbc_dec_verify(cipher, enc_ctx, mac_ctx, decrypted, decrypted, blockscount, iv, tag, 0) == 0);
+        assert(!memcmp(decrypted, data, sizeof(data)) && "in-place dec_verify failed");
+    }
+}
+
 int main() {
     RUN_TEST(test_spnet32);
     RUN_TEST(test_feistel_spnet32);
     RUN_TEST(test_des);
+    RUN_TEST(test_cbc_multi);
+    RUN_TEST(test_cipher_descriptors);
+    RUN_TEST(test_dispatch);
+    RUN_TEST(test_keyed);
+    RUN_TEST(test_sector);
+    RUN_TEST(test_fixed_rounds);
+    RUN_TEST(test_analysis);
+    RUN_TEST(test_mode_job);
+    RUN_TEST(test_enc_mac);
+    dispatch_report(stderr);
     return 0;
 }